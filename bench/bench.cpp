@@ -0,0 +1,506 @@
+// headless benchmark: run Litpression::process over a clip or an image sequence
+// for a matrix of resolutions, flow algorithms and settings presets,
+// and report results as json on stdout
+#include "advect.hpp"
+#include "flow.hpp"
+#include "litpression.hpp"
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <fstream>
+#include <getopt.h>
+#include <iostream>
+#include <opencv2/opencv.hpp>
+#include <random>
+#include <sstream>
+#include <string>
+#include <sys/resource.h>
+#include <vector>
+
+using std::string;
+using std::vector;
+
+struct Preset
+{
+    string name;
+    litpression::Settings settings;
+};
+
+vector<Preset> init_presets()
+{
+    vector<Preset> presets;
+
+    litpression::Settings settings;
+    presets.push_back({ "default", settings });
+
+    // few thick strokes
+    settings = litpression::Settings();
+    settings.min_radius = 5;
+    settings.max_radius = 15;
+    settings.min_length = 5;
+    settings.max_length = 40;
+    settings.max_triangle_area = 100;
+    settings.min_dist_sq = 80;
+    presets.push_back({ "coarse", settings });
+
+    // many thin strokes
+    settings = litpression::Settings();
+    settings.min_radius = 2;
+    settings.max_radius = 5;
+    settings.min_length = 3;
+    settings.max_length = 15;
+    settings.max_triangle_area = 12;
+    settings.min_dist_sq = 10;
+    presets.push_back({ "fine", settings });
+
+    return presets;
+}
+
+vector<string> split(const string& str, char sep)
+{
+    vector<string> parts;
+    std::stringstream ss(str);
+    string part;
+    while (std::getline(ss, part, sep)) {
+        if (!part.empty()) {
+            parts.push_back(part);
+        }
+    }
+    return parts;
+}
+
+string json_escape(const string& str)
+{
+    string escaped;
+    for (char c : str) {
+        if (c == '"' || c == '\\') {
+            escaped.push_back('\\');
+        }
+        escaped.push_back(c);
+    }
+    return escaped;
+}
+
+// load frames in memory so that decoding is not part of measures
+vector<cv::Mat3b> load_frames(const string& path, int max_frames)
+{
+    vector<cv::Mat3b> frames;
+
+    if (path.find('%') != string::npos) {
+        // image sequence, numbered from 1 as in litpression cli
+        for (int frame_i = 1; (int) frames.size() < max_frames; frame_i++) {
+            char frame_path[1024];
+            snprintf(frame_path, 1024, path.c_str(), frame_i);
+            cv::Mat3b frame = cv::imread(frame_path);
+            if (frame.data == nullptr) {
+                break;
+            }
+            frames.push_back(frame);
+        }
+    } else {
+        cv::VideoCapture cap(path);
+        if (!cap.isOpened()) {
+            std::cerr << "Failed to open video at path: " << path << std::endl;
+            exit(EXIT_FAILURE);
+        }
+        cv::Mat3b frame;
+        while ((int) frames.size() < max_frames && cap.read(frame)) {
+            frames.push_back(frame.clone());
+        }
+    }
+
+    return frames;
+}
+
+// reset peak rss so that each run is measured independently (linux only)
+void reset_peak_rss()
+{
+    std::ofstream clear_refs("/proc/self/clear_refs");
+    if (clear_refs) {
+        clear_refs << "5";
+    }
+}
+
+long peak_rss_kb()
+{
+    std::ifstream status("/proc/self/status");
+    string line;
+    while (std::getline(status, line)) {
+        if (line.compare(0, 6, "VmHWM:") == 0) {
+            return std::stol(line.substr(6));
+        }
+    }
+
+    // fallback to lifetime peak
+    struct rusage usage = {};
+    getrusage(RUSAGE_SELF, &usage);
+    return usage.ru_maxrss;
+}
+
+// nearest-rank percentile of sorted values
+double percentile(const vector<double>& sorted, double p)
+{
+    if (sorted.empty()) {
+        return 0.0;
+    }
+    size_t rank = (size_t) std::ceil(p / 100.0 * sorted.size());
+    return sorted[rank > 0 ? rank - 1 : 0];
+}
+
+void run(const vector<cv::Mat3b>& frames,
+    const string& flow_name,
+    const Preset& preset,
+    litpression::DensityBackend density_backend,
+    bool pipelined,
+    int flow_downscale,
+    int nb_warmup,
+    std::ostream& json)
+{
+    auto flow_alg = litpression::create_flow_alg(flow_name);
+    litpression::Litpression lit(flow_alg);
+    lit.settings = preset.settings;
+    if (flow_name == litpression::LK_FLOW_ALG_NAME) {
+        lit.settings.flow_mode = litpression::FlowMode::lk;
+    }
+    lit.settings.density_backend = density_backend;
+    lit.settings.flow_downscale = flow_downscale;
+
+    reset_peak_rss();
+
+    vector<double> latencies;
+    vector<size_t> nb_strokes;
+    latencies.reserve(frames.size());
+    nb_strokes.reserve(frames.size());
+
+    for (size_t i = 0; i < frames.size(); i++) {
+        auto start = std::chrono::steady_clock::now();
+        if (!pipelined) {
+            lit.process(frames[i]);
+        } else if (i + 1 < frames.size()) {
+            lit.process_pipelined(frames[i]);
+        } else {
+            // last frame must be rendered within its call
+            lit.process_pipelined(frames[i]);
+            lit.flush();
+        }
+        std::chrono::duration<double, std::milli> elapsed = std::chrono::steady_clock::now() - start;
+
+        if ((int) i >= nb_warmup) {
+            latencies.push_back(elapsed.count());
+            nb_strokes.push_back(lit.nb_strokes());
+        }
+    }
+
+    double total_ms = 0.0;
+    for (auto l : latencies) {
+        total_ms += l;
+    }
+    double fps = total_ms > 0.0 ? latencies.size() * 1000.0 / total_ms : 0.0;
+    double mean_ms = latencies.empty() ? 0.0 : total_ms / latencies.size();
+
+    double strokes_mean = 0.0;
+    for (auto n : nb_strokes) {
+        strokes_mean += n;
+    }
+    strokes_mean = nb_strokes.empty() ? 0.0 : strokes_mean / nb_strokes.size();
+    auto strokes_minmax = std::minmax_element(nb_strokes.begin(), nb_strokes.end());
+
+    std::sort(latencies.begin(), latencies.end());
+
+    json << "    {\n";
+    json << "      \"width\": " << frames[0].cols << ",\n";
+    json << "      \"height\": " << frames[0].rows << ",\n";
+    json << "      \"flow\": \"" << flow_name << "\",\n";
+    json << "      \"preset\": \"" << preset.name << "\",\n";
+    json << "      \"density\": \"" << litpression::density_backend_name(density_backend) << "\",\n";
+    json << "      \"mode\": \"" << (pipelined ? "pipelined" : "sync") << "\",\n";
+    json << "      \"flow_downscale\": " << flow_downscale << ",\n";
+    json << "      \"frames\": " << latencies.size() << ",\n";
+    json << "      \"fps\": " << fps << ",\n";
+    json << "      \"latency_ms\": { \"mean\": " << mean_ms
+         << ", \"p50\": " << percentile(latencies, 50)
+         << ", \"p95\": " << percentile(latencies, 95)
+         << ", \"p99\": " << percentile(latencies, 99)
+         << ", \"max\": " << (latencies.empty() ? 0.0 : latencies.back()) << " },\n";
+
+    // rolling mean over the last frames of the run
+    const auto& stats = lit.get_stats();
+    json << "      \"stages_mean_ms\": {";
+    for (size_t s = 0; s < litpression::nb_stages; s++) {
+        auto stage = (litpression::Stage) s;
+        json << (s > 0 ? ", " : " ") << "\"" << litpression::stage_name(stage) << "\": " << stats.mean(stage);
+    }
+    json << " },\n";
+
+    json << "      \"peak_rss_kb\": " << peak_rss_kb() << ",\n";
+    if (nb_strokes.empty()) {
+        json << "      \"strokes\": null\n";
+    } else {
+        json << "      \"strokes\": { \"min\": " << *strokes_minmax.first
+             << ", \"mean\": " << strokes_mean
+             << ", \"max\": " << *strokes_minmax.second
+             << ", \"last\": " << nb_strokes.back() << " }\n";
+    }
+    json << "    }";
+}
+
+typedef size_t (*AdvectKernel)(float* xs, float* ys, int* xs_int, int* ys_int, size_t n,
+    const litpression::FlowField& flow, int width, int height, uint32_t* out_ids);
+
+// time advection kernels alone, on flow between first 2 frames
+// with points at random positions
+void run_advect(const vector<cv::Mat3b>& frames, const string& flow_name, int nb_points, int nb_reps, bool& first, std::ostream& json)
+{
+    cv::Mat1b gray_prev, gray;
+    cv::cvtColor(frames[0], gray_prev, cv::COLOR_BGR2GRAY);
+    cv::cvtColor(frames[1], gray, cv::COLOR_BGR2GRAY);
+    cv::Mat2f flow;
+    litpression::create_flow_alg(flow_name)->calc(gray_prev, gray, flow);
+
+    int width = flow.cols;
+    int height = flow.rows;
+    litpression::FlowField flow_field;
+    flow_field.data = flow.ptr<float>();
+    flow_field.step = flow.step1();
+    flow_field.width = width;
+    flow_field.height = height;
+    std::mt19937 rng(0);
+    std::uniform_real_distribution<float> x_distr(0.0f, width - 1.0f);
+    std::uniform_real_distribution<float> y_distr(0.0f, height - 1.0f);
+    vector<float> xs_init(nb_points), ys_init(nb_points);
+    for (int i = 0; i < nb_points; i++) {
+        xs_init[i] = x_distr(rng);
+        ys_init[i] = y_distr(rng);
+    }
+
+    string simd_name = string("bilinear_") + litpression::advect_bilinear_isa();
+    vector<std::pair<string, AdvectKernel>> kernels = {
+        { "nearest", litpression::advect_nearest },
+        { "bilinear_scalar", litpression::advect_bilinear_scalar },
+        { simd_name, litpression::advect_bilinear },
+    };
+
+    vector<float> xs, ys;
+    vector<int> xs_int(nb_points), ys_int(nb_points);
+    vector<uint32_t> out_ids(nb_points);
+    for (const auto& kernel : kernels) {
+        double total_ms = 0.0;
+        for (int r = 0; r < nb_reps; r++) {
+            // restore positions, out of measures
+            xs = xs_init;
+            ys = ys_init;
+            auto start = std::chrono::steady_clock::now();
+            kernel.second(xs.data(), ys.data(), xs_int.data(), ys_int.data(), nb_points,
+                flow_field, width, height, out_ids.data());
+            std::chrono::duration<double, std::milli> elapsed = std::chrono::steady_clock::now() - start;
+            total_ms += elapsed.count();
+        }
+
+        if (!first) {
+            json << ",\n";
+        }
+        first = false;
+        json << "    { \"width\": " << width << ", \"height\": " << height << ", \"points\": " << nb_points
+             << ", \"kernel\": \"" << kernel.first << "\", \"mean_ms\": " << total_ms / nb_reps
+             << ", \"ns_per_point\": " << total_ms * 1e6 / nb_reps / nb_points << " }";
+    }
+}
+
+void usage(const char* exec_name)
+{
+    std::cerr << "Usage: " << exec_name << " [options] <path_to_video | path_to_seq_%d.png>\n";
+    std::cerr << "Options:\n";
+    std::cerr << "  -n <nb>\t\tMaximum number of frames to load (default: 100)\n";
+    std::cerr << "  -w <nb>\t\tNumber of warm-up frames excluded from measures (default: 5)\n";
+    std::cerr << "  -r <WxH,...>\t\tResolutions to benchmark (default: native)\n";
+    std::cerr << "  -f <name,...>\t\tFlow algorithms to benchmark (" << litpression::FLOW_ALG_NAMES << ", default: dis)\n";
+    std::cerr << "  -p <name,...>\t\tSettings presets to benchmark (default, coarse, fine, default: default)\n";
+    std::cerr << "  -d <name,...>\t\tDensity backends to benchmark (triangle, mesh, grid, default: triangle)\n";
+    std::cerr << "  -m <name,...>\t\tProcessing modes to benchmark (sync, pipelined, default: sync)\n";
+    std::cerr << "  -s <nb,...>\t\tFlow downscale factors to benchmark (default: 1)\n";
+    std::cerr << "  -k <nb>\t\tAlso benchmark advection kernels alone with nb points (default: 0, disabled)\n";
+}
+
+int main(int argc, char* argv[])
+{
+    int max_frames = 100;
+    int nb_warmup = 5;
+    vector<string> resolutions;
+    vector<string> flow_names = { "dis" };
+    vector<string> preset_names = { "default" };
+    vector<string> density_names = { "triangle" };
+    vector<string> mode_names = { "sync" };
+    vector<string> downscale_names = { "1" };
+    int nb_advect_points = 0;
+
+    int opt;
+    while ((opt = getopt(argc, argv, "n:w:r:f:p:d:m:s:k:")) != -1) {
+        switch (opt) {
+        case 'n':
+            max_frames = std::stoi(optarg);
+            break;
+        case 'w':
+            nb_warmup = std::stoi(optarg);
+            break;
+        case 'r':
+            resolutions = split(optarg, ',');
+            break;
+        case 'f':
+            flow_names = split(optarg, ',');
+            break;
+        case 'p':
+            preset_names = split(optarg, ',');
+            break;
+        case 'd':
+            density_names = split(optarg, ',');
+            break;
+        case 'm':
+            mode_names = split(optarg, ',');
+            break;
+        case 's':
+            downscale_names = split(optarg, ',');
+            break;
+        case 'k':
+            nb_advect_points = std::stoi(optarg);
+            break;
+        default:
+            usage(argv[0]);
+            exit(EXIT_FAILURE);
+        }
+    }
+
+    if (argc - optind != 1) {
+        usage(argv[0]);
+        exit(EXIT_FAILURE);
+    }
+    string in_path = argv[optind];
+
+    // validate matrix before loading anything
+    for (const auto& name : flow_names) {
+        if (name != litpression::LK_FLOW_ALG_NAME && litpression::create_flow_alg(name) == nullptr) {
+            std::cerr << "Unknown flow algorithm: \"" << name << "\"\n";
+            exit(EXIT_FAILURE);
+        }
+    }
+    // advection kernels need a dense flow
+    string advect_flow_name;
+    for (const auto& name : flow_names) {
+        if (name != litpression::LK_FLOW_ALG_NAME) {
+            advect_flow_name = name;
+            break;
+        }
+    }
+    auto all_presets = init_presets();
+    vector<Preset> presets;
+    for (const auto& name : preset_names) {
+        auto it = std::find_if(all_presets.begin(), all_presets.end(), [&](const Preset& p) { return p.name == name; });
+        if (it == all_presets.end()) {
+            std::cerr << "Unknown preset: \"" << name << "\"\n";
+            exit(EXIT_FAILURE);
+        }
+        presets.push_back(*it);
+    }
+    vector<litpression::DensityBackend> density_backends;
+    for (const auto& name : density_names) {
+        litpression::DensityBackend backend;
+        if (!litpression::density_backend_from_name(name, backend)) {
+            std::cerr << "Unknown density backend: \"" << name << "\"\n";
+            exit(EXIT_FAILURE);
+        }
+        density_backends.push_back(backend);
+    }
+    vector<bool> modes;
+    for (const auto& name : mode_names) {
+        if (name != "sync" && name != "pipelined") {
+            std::cerr << "Unknown processing mode: \"" << name << "\"\n";
+            exit(EXIT_FAILURE);
+        }
+        modes.push_back(name == "pipelined");
+    }
+    vector<int> flow_downscales;
+    for (const auto& name : downscale_names) {
+        int s = std::atoi(name.c_str());
+        if (s < 1) {
+            std::cerr << "Invalid flow downscale factor: \"" << name << "\"\n";
+            exit(EXIT_FAILURE);
+        }
+        flow_downscales.push_back(s);
+    }
+    vector<cv::Size> sizes;
+    for (const auto& res : resolutions) {
+        int w = 0, h = 0;
+        if (sscanf(res.c_str(), "%dx%d", &w, &h) != 2 || w <= 0 || h <= 0) {
+            std::cerr << "Invalid resolution: \"" << res << "\"\n";
+            exit(EXIT_FAILURE);
+        }
+        sizes.emplace_back(w, h);
+    }
+
+    auto frames = load_frames(in_path, max_frames);
+    if ((int) frames.size() <= nb_warmup) {
+        std::cerr << "Not enough frames loaded (" << frames.size() << ") for " << nb_warmup << " warm-up frames\n";
+        exit(EXIT_FAILURE);
+    }
+    if (sizes.empty()) {
+        sizes.push_back(frames[0].size());
+    }
+
+    std::ostream& json = std::cout;
+    json << "{\n";
+    json << "  \"input\": \"" << json_escape(in_path) << "\",\n";
+    json << "  \"warmup\": " << nb_warmup << ",\n";
+    json << "  \"runs\": [\n";
+
+    bool first_run = true;
+    bool first_advect = true;
+    std::stringstream advect_json;
+    for (const auto& size : sizes) {
+        vector<cv::Mat3b> frames_resized;
+        frames_resized.reserve(frames.size());
+        for (const auto& f : frames) {
+            if (f.size() == size) {
+                frames_resized.push_back(f);
+            } else {
+                cv::Mat3b resized;
+                cv::resize(f, resized, size, 0, 0, cv::INTER_AREA);
+                frames_resized.push_back(resized);
+            }
+        }
+
+        for (const auto& flow_name : flow_names) {
+            for (const auto& preset : presets) {
+                for (auto density_backend : density_backends) {
+                    for (bool pipelined : modes) {
+                        for (int flow_downscale : flow_downscales) {
+                            std::cerr << "bench: " << size.width << "x" << size.height << " " << flow_name << " " << preset.name
+                                      << " " << litpression::density_backend_name(density_backend)
+                                      << " " << (pipelined ? "pipelined" : "sync") << " flow/" << flow_downscale << "\n";
+                            if (!first_run) {
+                                json << ",\n";
+                            }
+                            run(frames_resized, flow_name, preset, density_backend, pipelined, flow_downscale, nb_warmup, json);
+                            json.flush();
+                            first_run = false;
+                        }
+                    }
+                }
+            }
+        }
+
+        if (nb_advect_points > 0 && advect_flow_name.empty()) {
+            std::cerr << "bench: no dense flow algorithm for advection kernels\n";
+        } else if (nb_advect_points > 0) {
+            std::cerr << "bench: " << size.width << "x" << size.height << " advection kernels\n";
+            run_advect(frames_resized, advect_flow_name, nb_advect_points, 100, first_advect, advect_json);
+        }
+    }
+
+    json << "\n  ]";
+    if (nb_advect_points > 0) {
+        json << ",\n  \"advect\": [\n" << advect_json.str() << "\n  ]";
+    }
+    json << "\n";
+    json << "}\n";
+
+    return 0;
+}
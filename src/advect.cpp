@@ -0,0 +1,324 @@
+#include "advect.hpp"
+#include <algorithm>
+#include <cmath>
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#include <xmmintrin.h>
+#endif
+
+namespace litpression {
+
+size_t advect_nearest(float* xs, float* ys, int* xs_int, int* ys_int, size_t n,
+    const FlowField& flow, int width, int height, uint32_t* out_ids)
+{
+    float inv_scale_x = 1.0f / flow.scale_x;
+    float inv_scale_y = 1.0f / flow.scale_y;
+
+    size_t nb_out = 0;
+    for (size_t i = 0; i < n; i++) {
+        int fx = std::min((int) (xs[i] * inv_scale_x), flow.width - 1);
+        int fy = std::min((int) (ys[i] * inv_scale_y), flow.height - 1);
+        const float* dxy = flow.data + fy * flow.step + fx * 2;
+        xs[i] += dxy[0] * flow.scale_x;
+        ys[i] += dxy[1] * flow.scale_y;
+        xs_int[i] = (int) std::round(xs[i]);
+        ys_int[i] = (int) std::round(ys[i]);
+
+        if (xs_int[i] < 0 || xs_int[i] > width - 1 || ys_int[i] < 0 || ys_int[i] > height - 1) {
+            out_ids[nb_out++] = (uint32_t) i;
+        }
+    }
+    return nb_out;
+}
+
+// mapping of image positions to flow positions, aligning pixel centers:
+// flow position = position * inv_scale + offset
+struct FlowMapping
+{
+    float inv_scale_x, inv_scale_y;
+    float offset_x, offset_y;
+
+    FlowMapping(const FlowField& flow)
+    {
+        inv_scale_x = 1.0f / flow.scale_x;
+        inv_scale_y = 1.0f / flow.scale_y;
+        offset_x = 0.5f * inv_scale_x - 0.5f;
+        offset_y = 0.5f * inv_scale_y - 0.5f;
+    }
+};
+
+// return true if point is out of bounds after moving
+// NB: rounding is floor(v + 0.5) to match vectorized kernels
+static inline bool advect_bilinear_one(size_t i, float* xs, float* ys, int* xs_int, int* ys_int,
+    const FlowField& flow, const FlowMapping& mapping, int width, int height)
+{
+    float x = std::min(std::max(xs[i] * mapping.inv_scale_x + mapping.offset_x, 0.0f), (float) (flow.width - 1));
+    float y = std::min(std::max(ys[i] * mapping.inv_scale_y + mapping.offset_y, 0.0f), (float) (flow.height - 1));
+    // top left sample, so that all 4 samples are within bounds
+    int x0 = std::min((int) x, flow.width - 2);
+    int y0 = std::min((int) y, flow.height - 2);
+    float fx = x - x0;
+    float fy = y - y0;
+
+    const float* top = flow.data + y0 * flow.step + x0 * 2;
+    const float* bottom = top + flow.step;
+    float dx_top = top[0] + fx * (top[2] - top[0]);
+    float dy_top = top[1] + fx * (top[3] - top[1]);
+    float dx_bottom = bottom[0] + fx * (bottom[2] - bottom[0]);
+    float dy_bottom = bottom[1] + fx * (bottom[3] - bottom[1]);
+
+    xs[i] += (dx_top + fy * (dx_bottom - dx_top)) * flow.scale_x;
+    ys[i] += (dy_top + fy * (dy_bottom - dy_top)) * flow.scale_y;
+    xs_int[i] = (int) std::floor(xs[i] + 0.5f);
+    ys_int[i] = (int) std::floor(ys[i] + 0.5f);
+
+    return xs_int[i] < 0 || xs_int[i] > width - 1 || ys_int[i] < 0 || ys_int[i] > height - 1;
+}
+
+size_t advect_bilinear_scalar(float* xs, float* ys, int* xs_int, int* ys_int, size_t n,
+    const FlowField& flow, int width, int height, uint32_t* out_ids)
+{
+    // no room for bilinear sampling
+    if (flow.width < 2 || flow.height < 2) {
+        return advect_nearest(xs, ys, xs_int, ys_int, n, flow, width, height, out_ids);
+    }
+
+    FlowMapping mapping(flow);
+    size_t nb_out = 0;
+    for (size_t i = 0; i < n; i++) {
+        if (advect_bilinear_one(i, xs, ys, xs_int, ys_int, flow, mapping, width, height)) {
+            out_ids[nb_out++] = (uint32_t) i;
+        }
+    }
+    return nb_out;
+}
+
+#if defined(__AVX2__)
+
+const char* advect_bilinear_isa()
+{
+    return "avx2";
+}
+
+size_t advect_bilinear(float* xs, float* ys, int* xs_int, int* ys_int, size_t n,
+    const FlowField& flow, int width, int height, uint32_t* out_ids)
+{
+    if (flow.width < 2 || flow.height < 2) {
+        return advect_nearest(xs, ys, xs_int, ys_int, n, flow, width, height, out_ids);
+    }
+
+    FlowMapping mapping(flow);
+    const float* data = flow.data;
+    const __m256 zero = _mm256_setzero_ps();
+    const __m256 half = _mm256_set1_ps(0.5f);
+    const __m256 inv_scale_x = _mm256_set1_ps(mapping.inv_scale_x);
+    const __m256 inv_scale_y = _mm256_set1_ps(mapping.inv_scale_y);
+    const __m256 offset_x = _mm256_set1_ps(mapping.offset_x);
+    const __m256 offset_y = _mm256_set1_ps(mapping.offset_y);
+    const __m256 scale_x = _mm256_set1_ps(flow.scale_x);
+    const __m256 scale_y = _mm256_set1_ps(flow.scale_y);
+    const __m256 max_x = _mm256_set1_ps((float) (flow.width - 1));
+    const __m256 max_y = _mm256_set1_ps((float) (flow.height - 1));
+    const __m256i max_x0 = _mm256_set1_epi32(flow.width - 2);
+    const __m256i max_y0 = _mm256_set1_epi32(flow.height - 2);
+    const __m256i max_x_int = _mm256_set1_epi32(width - 1);
+    const __m256i max_y_int = _mm256_set1_epi32(height - 1);
+    const __m256i zero_int = _mm256_setzero_si256();
+    const __m256i step = _mm256_set1_epi32((int) flow.step);
+
+    size_t nb_out = 0;
+    size_t i = 0;
+    for (; i + 8 <= n; i += 8) {
+        __m256 x = _mm256_loadu_ps(xs + i);
+        __m256 y = _mm256_loadu_ps(ys + i);
+
+        __m256 xc = _mm256_add_ps(_mm256_mul_ps(x, inv_scale_x), offset_x);
+        __m256 yc = _mm256_add_ps(_mm256_mul_ps(y, inv_scale_y), offset_y);
+        xc = _mm256_min_ps(_mm256_max_ps(xc, zero), max_x);
+        yc = _mm256_min_ps(_mm256_max_ps(yc, zero), max_y);
+        __m256i x0 = _mm256_min_epi32(_mm256_cvttps_epi32(xc), max_x0);
+        __m256i y0 = _mm256_min_epi32(_mm256_cvttps_epi32(yc), max_y0);
+        __m256 fx = _mm256_sub_ps(xc, _mm256_cvtepi32_ps(x0));
+        __m256 fy = _mm256_sub_ps(yc, _mm256_cvtepi32_ps(y0));
+
+        // offsets of top left and bottom left samples, in floats
+        __m256i top = _mm256_add_epi32(_mm256_mullo_epi32(y0, step), _mm256_slli_epi32(x0, 1));
+        __m256i bottom = _mm256_add_epi32(top, step);
+
+        __m256 dx_tl = _mm256_i32gather_ps(data, top, 4);
+        __m256 dy_tl = _mm256_i32gather_ps(data + 1, top, 4);
+        __m256 dx_tr = _mm256_i32gather_ps(data + 2, top, 4);
+        __m256 dy_tr = _mm256_i32gather_ps(data + 3, top, 4);
+        __m256 dx_bl = _mm256_i32gather_ps(data, bottom, 4);
+        __m256 dy_bl = _mm256_i32gather_ps(data + 1, bottom, 4);
+        __m256 dx_br = _mm256_i32gather_ps(data + 2, bottom, 4);
+        __m256 dy_br = _mm256_i32gather_ps(data + 3, bottom, 4);
+
+        __m256 dx_top = _mm256_add_ps(dx_tl, _mm256_mul_ps(fx, _mm256_sub_ps(dx_tr, dx_tl)));
+        __m256 dy_top = _mm256_add_ps(dy_tl, _mm256_mul_ps(fx, _mm256_sub_ps(dy_tr, dy_tl)));
+        __m256 dx_bottom = _mm256_add_ps(dx_bl, _mm256_mul_ps(fx, _mm256_sub_ps(dx_br, dx_bl)));
+        __m256 dy_bottom = _mm256_add_ps(dy_bl, _mm256_mul_ps(fx, _mm256_sub_ps(dy_br, dy_bl)));
+        __m256 dx = _mm256_add_ps(dx_top, _mm256_mul_ps(fy, _mm256_sub_ps(dx_bottom, dx_top)));
+        __m256 dy = _mm256_add_ps(dy_top, _mm256_mul_ps(fy, _mm256_sub_ps(dy_bottom, dy_top)));
+
+        x = _mm256_add_ps(x, _mm256_mul_ps(dx, scale_x));
+        y = _mm256_add_ps(y, _mm256_mul_ps(dy, scale_y));
+        __m256i x_int = _mm256_cvttps_epi32(_mm256_floor_ps(_mm256_add_ps(x, half)));
+        __m256i y_int = _mm256_cvttps_epi32(_mm256_floor_ps(_mm256_add_ps(y, half)));
+
+        _mm256_storeu_ps(xs + i, x);
+        _mm256_storeu_ps(ys + i, y);
+        _mm256_storeu_si256((__m256i*) (xs_int + i), x_int);
+        _mm256_storeu_si256((__m256i*) (ys_int + i), y_int);
+
+        // cull in same pass
+        __m256i out = _mm256_or_si256(
+            _mm256_or_si256(_mm256_cmpgt_epi32(zero_int, x_int), _mm256_cmpgt_epi32(x_int, max_x_int)),
+            _mm256_or_si256(_mm256_cmpgt_epi32(zero_int, y_int), _mm256_cmpgt_epi32(y_int, max_y_int)));
+        unsigned out_mask = (unsigned) _mm256_movemask_ps(_mm256_castsi256_ps(out));
+        while (out_mask != 0) {
+            out_ids[nb_out++] = (uint32_t) (i + __builtin_ctz(out_mask));
+            out_mask &= out_mask - 1;
+        }
+    }
+
+    for (; i < n; i++) {
+        if (advect_bilinear_one(i, xs, ys, xs_int, ys_int, flow, mapping, width, height)) {
+            out_ids[nb_out++] = (uint32_t) i;
+        }
+    }
+    return nb_out;
+}
+
+#elif defined(__SSE2__)
+
+const char* advect_bilinear_isa()
+{
+    return "sse2";
+}
+
+// floor for values in int range, without SSE4.1
+static inline __m128i floor_epi32(__m128 v)
+{
+    __m128i t = _mm_cvttps_epi32(v);
+    // truncation rounded up negative values, subtract 1 (all bits set) from them
+    return _mm_add_epi32(t, _mm_castps_si128(_mm_cmpgt_ps(_mm_cvtepi32_ps(t), v)));
+}
+
+size_t advect_bilinear(float* xs, float* ys, int* xs_int, int* ys_int, size_t n,
+    const FlowField& flow, int width, int height, uint32_t* out_ids)
+{
+    if (flow.width < 2 || flow.height < 2) {
+        return advect_nearest(xs, ys, xs_int, ys_int, n, flow, width, height, out_ids);
+    }
+
+    FlowMapping mapping(flow);
+    const float* data = flow.data;
+    const size_t step = flow.step;
+    const __m128 zero = _mm_setzero_ps();
+    const __m128 half = _mm_set1_ps(0.5f);
+    const __m128 inv_scale_x = _mm_set1_ps(mapping.inv_scale_x);
+    const __m128 inv_scale_y = _mm_set1_ps(mapping.inv_scale_y);
+    const __m128 offset_x = _mm_set1_ps(mapping.offset_x);
+    const __m128 offset_y = _mm_set1_ps(mapping.offset_y);
+    const __m128 scale_x = _mm_set1_ps(flow.scale_x);
+    const __m128 scale_y = _mm_set1_ps(flow.scale_y);
+    const __m128 max_x = _mm_set1_ps((float) (flow.width - 1));
+    const __m128 max_y = _mm_set1_ps((float) (flow.height - 1));
+    const __m128 max_x0 = _mm_set1_ps((float) (flow.width - 2));
+    const __m128 max_y0 = _mm_set1_ps((float) (flow.height - 2));
+    const __m128i max_x_int = _mm_set1_epi32(width - 1);
+    const __m128i max_y_int = _mm_set1_epi32(height - 1);
+    const __m128i zero_int = _mm_setzero_si128();
+
+    size_t nb_out = 0;
+    size_t i = 0;
+    for (; i + 4 <= n; i += 4) {
+        __m128 x = _mm_loadu_ps(xs + i);
+        __m128 y = _mm_loadu_ps(ys + i);
+
+        __m128 xc = _mm_add_ps(_mm_mul_ps(x, inv_scale_x), offset_x);
+        __m128 yc = _mm_add_ps(_mm_mul_ps(y, inv_scale_y), offset_y);
+        xc = _mm_min_ps(_mm_max_ps(xc, zero), max_x);
+        yc = _mm_min_ps(_mm_max_ps(yc, zero), max_y);
+        // clamped values are non negative, truncation is floor
+        __m128i x0 = _mm_cvttps_epi32(_mm_min_ps(xc, max_x0));
+        __m128i y0 = _mm_cvttps_epi32(_mm_min_ps(yc, max_y0));
+        __m128 fx = _mm_sub_ps(xc, _mm_cvtepi32_ps(x0));
+        __m128 fy = _mm_sub_ps(yc, _mm_cvtepi32_ps(y0));
+
+        // no gather: load (dx, dy) of left and right samples of each lane at once,
+        // then transpose to get one register per sample component
+        alignas(16) int32_t x0s[4], y0s[4];
+        _mm_store_si128((__m128i*) x0s, x0);
+        _mm_store_si128((__m128i*) y0s, y0);
+        const float* top0 = data + y0s[0] * step + x0s[0] * 2;
+        const float* top1 = data + y0s[1] * step + x0s[1] * 2;
+        const float* top2 = data + y0s[2] * step + x0s[2] * 2;
+        const float* top3 = data + y0s[3] * step + x0s[3] * 2;
+        __m128 dx_tl = _mm_loadu_ps(top0);
+        __m128 dy_tl = _mm_loadu_ps(top1);
+        __m128 dx_tr = _mm_loadu_ps(top2);
+        __m128 dy_tr = _mm_loadu_ps(top3);
+        _MM_TRANSPOSE4_PS(dx_tl, dy_tl, dx_tr, dy_tr);
+        __m128 dx_bl = _mm_loadu_ps(top0 + step);
+        __m128 dy_bl = _mm_loadu_ps(top1 + step);
+        __m128 dx_br = _mm_loadu_ps(top2 + step);
+        __m128 dy_br = _mm_loadu_ps(top3 + step);
+        _MM_TRANSPOSE4_PS(dx_bl, dy_bl, dx_br, dy_br);
+
+        __m128 dx_top = _mm_add_ps(dx_tl, _mm_mul_ps(fx, _mm_sub_ps(dx_tr, dx_tl)));
+        __m128 dy_top = _mm_add_ps(dy_tl, _mm_mul_ps(fx, _mm_sub_ps(dy_tr, dy_tl)));
+        __m128 dx_bottom = _mm_add_ps(dx_bl, _mm_mul_ps(fx, _mm_sub_ps(dx_br, dx_bl)));
+        __m128 dy_bottom = _mm_add_ps(dy_bl, _mm_mul_ps(fx, _mm_sub_ps(dy_br, dy_bl)));
+        __m128 dx = _mm_add_ps(dx_top, _mm_mul_ps(fy, _mm_sub_ps(dx_bottom, dx_top)));
+        __m128 dy = _mm_add_ps(dy_top, _mm_mul_ps(fy, _mm_sub_ps(dy_bottom, dy_top)));
+
+        x = _mm_add_ps(x, _mm_mul_ps(dx, scale_x));
+        y = _mm_add_ps(y, _mm_mul_ps(dy, scale_y));
+        __m128i x_int = floor_epi32(_mm_add_ps(x, half));
+        __m128i y_int = floor_epi32(_mm_add_ps(y, half));
+
+        _mm_storeu_ps(xs + i, x);
+        _mm_storeu_ps(ys + i, y);
+        _mm_storeu_si128((__m128i*) (xs_int + i), x_int);
+        _mm_storeu_si128((__m128i*) (ys_int + i), y_int);
+
+        // cull in same pass
+        __m128i out = _mm_or_si128(
+            _mm_or_si128(_mm_cmpgt_epi32(zero_int, x_int), _mm_cmpgt_epi32(x_int, max_x_int)),
+            _mm_or_si128(_mm_cmpgt_epi32(zero_int, y_int), _mm_cmpgt_epi32(y_int, max_y_int)));
+        unsigned out_mask = (unsigned) _mm_movemask_ps(_mm_castsi128_ps(out));
+        while (out_mask != 0) {
+            out_ids[nb_out++] = (uint32_t) (i + __builtin_ctz(out_mask));
+            out_mask &= out_mask - 1;
+        }
+    }
+
+    for (; i < n; i++) {
+        if (advect_bilinear_one(i, xs, ys, xs_int, ys_int, flow, mapping, width, height)) {
+            out_ids[nb_out++] = (uint32_t) i;
+        }
+    }
+    return nb_out;
+}
+
+#else
+
+const char* advect_bilinear_isa()
+{
+    return "scalar";
+}
+
+size_t advect_bilinear(float* xs, float* ys, int* xs_int, int* ys_int, size_t n,
+    const FlowField& flow, int width, int height, uint32_t* out_ids)
+{
+    return advect_bilinear_scalar(xs, ys, xs_int, ys_int, n, flow, width, height, out_ids);
+}
+
+#endif
+
+};
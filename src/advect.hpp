@@ -0,0 +1,43 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+namespace litpression {
+
+// dense flow field, possibly at lower resolution than image
+struct FlowField
+{
+    // 2 interleaved floats (dx, dy) per pixel, rows of step floats
+    const float* data = nullptr;
+    size_t step = 0;
+    int width = 0;
+    int height = 0;
+    // ratio between image size and flow size,
+    // flow is sampled at image positions divided by scale and its vectors are multiplied by scale
+    float scale_x = 1.0f;
+    float scale_y = 1.0f;
+};
+
+// Advection kernels: move points by flow.
+// Moved points are rounded into xs_int/ys_int, and ids of points whose rounded position
+// is out of [0, width - 1] x [0, height - 1] are written in increasing order to out_ids
+// (which must have room for n ids). Return the number of out of bounds points.
+// Points are expected to be within bounds before moving.
+
+// flow sampled at truncated position
+size_t advect_nearest(float* xs, float* ys, int* xs_int, int* ys_int, size_t n,
+    const FlowField& flow, int width, int height, uint32_t* out_ids);
+
+// flow sampled bilinearly at position clamped to bounds
+size_t advect_bilinear_scalar(float* xs, float* ys, int* xs_int, int* ys_int, size_t n,
+    const FlowField& flow, int width, int height, uint32_t* out_ids);
+
+// same as advect_bilinear_scalar, vectorized with the best instruction set enabled at compile time
+size_t advect_bilinear(float* xs, float* ys, int* xs_int, int* ys_int, size_t n,
+    const FlowField& flow, int width, int height, uint32_t* out_ids);
+
+// instruction set used by advect_bilinear ("avx2", "sse2" or "scalar")
+const char* advect_bilinear_isa();
+
+};
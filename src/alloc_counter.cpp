@@ -0,0 +1,143 @@
+#include "alloc_counter.hpp"
+#include <atomic>
+#include <cstdlib>
+#include <mutex>
+#include <new>
+#include <opencv2/opencv.hpp>
+
+namespace litpression {
+
+// NB: only counted in debug builds, release builds keep default allocation functions
+#ifdef DEBUG
+
+// NB: thread local, so that allocations of other threads (ex: frame reader) are not counted
+static thread_local size_t nb_mats = 0;
+static thread_local size_t nb_news = 0;
+static std::atomic<bool> enabled(false);
+
+// counts buffers allocated by default allocator, which does the actual work
+class CountingMatAllocator : public cv::MatAllocator
+{
+public:
+    CountingMatAllocator() : std_allocator(cv::Mat::getStdAllocator()) {}
+
+    cv::UMatData* allocate(int dims, const int* sizes, int type, void* data, size_t* step,
+        cv::AccessFlag flags, cv::UMatUsageFlags usage_flags) const override
+    {
+        // (user data is not allocated)
+        if (data == nullptr) {
+            nb_mats++;
+        }
+        return std_allocator->allocate(dims, sizes, type, data, step, flags, usage_flags);
+    }
+
+    bool allocate(cv::UMatData* data, cv::AccessFlag access_flags, cv::UMatUsageFlags usage_flags) const override
+    {
+        return std_allocator->allocate(data, access_flags, usage_flags);
+    }
+
+    void deallocate(cv::UMatData* data) const override
+    {
+        std_allocator->deallocate(data);
+    }
+
+private:
+    cv::MatAllocator* std_allocator;
+};
+
+void enable_alloc_counter()
+{
+    static std::once_flag once;
+    std::call_once(once, [] {
+        // never freed, buffers may outlive any owner
+        cv::Mat::setDefaultAllocator(new CountingMatAllocator());
+        enabled = true;
+    });
+}
+
+AllocCounts alloc_counts()
+{
+    AllocCounts counts;
+    counts.mats = nb_mats;
+    counts.news = nb_news;
+    return counts;
+}
+
+static void* counted_malloc(size_t size)
+{
+    if (enabled.load(std::memory_order_relaxed)) {
+        nb_news++;
+    }
+    void* p = std::malloc(size > 0 ? size : 1);
+    if (p == nullptr) {
+        throw std::bad_alloc();
+    }
+    return p;
+}
+
+#else
+
+void enable_alloc_counter() {}
+
+AllocCounts alloc_counts()
+{
+    return AllocCounts();
+}
+
+#endif
+
+};
+
+#ifdef DEBUG
+
+// replacements of global allocation functions, counting only once enabled
+
+void* operator new(size_t size)
+{
+    return litpression::counted_malloc(size);
+}
+
+void* operator new[](size_t size)
+{
+    return litpression::counted_malloc(size);
+}
+
+void* operator new(size_t size, const std::nothrow_t&) noexcept
+{
+    try {
+        return litpression::counted_malloc(size);
+    } catch (const std::bad_alloc&) {
+        return nullptr;
+    }
+}
+
+void* operator new[](size_t size, const std::nothrow_t&) noexcept
+{
+    try {
+        return litpression::counted_malloc(size);
+    } catch (const std::bad_alloc&) {
+        return nullptr;
+    }
+}
+
+void operator delete(void* p) noexcept
+{
+    std::free(p);
+}
+
+void operator delete[](void* p) noexcept
+{
+    std::free(p);
+}
+
+void operator delete(void* p, size_t) noexcept
+{
+    std::free(p);
+}
+
+void operator delete[](void* p, size_t) noexcept
+{
+    std::free(p);
+}
+
+#endif
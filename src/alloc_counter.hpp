@@ -0,0 +1,24 @@
+#pragma once
+
+#include <cstddef>
+
+namespace litpression {
+
+// debug counters of heap allocations made by calling thread
+// (DEBUG builds only, counters stay at 0 otherwise)
+struct AllocCounts
+{
+    // cv::Mat buffers (frame buffers and temporaries of OpenCV functions)
+    size_t mats = 0;
+    // operator new calls (containers, and OpenCV internals such as thread pool jobs)
+    size_t news = 0;
+};
+
+// start counting, counters stay at 0 until then
+// (installs a counting default cv::Mat allocator, must be called before other threads use OpenCV)
+void enable_alloc_counter();
+
+// counts of calling thread since counter has been enabled
+AllocCounts alloc_counts();
+
+};
@@ -0,0 +1,107 @@
+#pragma once
+
+#include <algorithm>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <mutex>
+#include <ostream>
+
+namespace litpression {
+
+// depth statistics of a bounded queue
+struct QueueStats
+{
+    size_t capacity = 0;
+    size_t nb_pushes = 0;
+    // sum of depths right after each push, for mean depth
+    size_t depth_sum = 0;
+    size_t max_depth = 0;
+    // number of pushes that waited for room (consumer too slow)
+    size_t nb_full_waits = 0;
+    // number of pops that waited for an item (producer too slow)
+    size_t nb_empty_waits = 0;
+
+    double mean_depth() const { return nb_pushes > 0 ? (double) depth_sum / nb_pushes : 0.0; }
+
+    void print(std::ostream& os, const char* name) const
+    {
+        os << name << ": capacity " << capacity << ", " << nb_pushes << " items, mean depth " << mean_depth()
+           << ", max depth " << max_depth << ", full waits " << nb_full_waits << ", empty waits " << nb_empty_waits << "\n";
+    }
+};
+
+// blocking FIFO queue with fixed capacity, for producer/consumer threads
+template <typename T>
+class BoundedQueue
+{
+public:
+    explicit BoundedQueue(size_t capacity) { stats.capacity = std::max((size_t) 1, capacity); }
+
+    // wait for room, return false if queue has been closed
+    bool push(T item)
+    {
+        std::unique_lock<std::mutex> lock(mutex);
+        if (!closed && items.size() >= stats.capacity) {
+            stats.nb_full_waits++;
+            not_full.wait(lock, [this] { return closed || items.size() < stats.capacity; });
+        }
+        if (closed) {
+            return false;
+        }
+
+        items.push_back(std::move(item));
+        stats.nb_pushes++;
+        stats.depth_sum += items.size();
+        stats.max_depth = std::max(stats.max_depth, items.size());
+        lock.unlock();
+        not_empty.notify_one();
+        return true;
+    }
+
+    // wait for an item, return false once queue is closed and drained
+    bool pop(T& item)
+    {
+        std::unique_lock<std::mutex> lock(mutex);
+        if (!closed && items.empty()) {
+            stats.nb_empty_waits++;
+            not_empty.wait(lock, [this] { return closed || !items.empty(); });
+        }
+        if (items.empty()) {
+            return false;
+        }
+
+        item = std::move(items.front());
+        items.pop_front();
+        lock.unlock();
+        not_full.notify_one();
+        return true;
+    }
+
+    // no more pushes accepted, waiting threads are woken up
+    void close()
+    {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            closed = true;
+        }
+        not_full.notify_all();
+        not_empty.notify_all();
+    }
+
+    QueueStats get_stats() const
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        return stats;
+    }
+
+private:
+    mutable std::mutex mutex;
+    std::condition_variable not_full;
+    std::condition_variable not_empty;
+    std::deque<T> items;
+    bool closed = false;
+    QueueStats stats;
+};
+
+};
@@ -0,0 +1,68 @@
+#include "budget.hpp"
+#include <algorithm>
+
+namespace litpression {
+
+// first frames (initial strokes, allocations) are not representative
+static const int WARMUP_FRAMES = 2;
+static const double EMA_ALPHA = 0.2;
+// go lighter as soon as over budget, go heavier only with enough headroom
+// for the next level not to be over budget again
+static const double OVER_RATIO = 1.0;
+static const double UNDER_RATIO = 0.7;
+// lighter quickly to recover frame rate, heavier slowly to avoid thrashing
+static const int OVER_FRAMES = 3;
+static const int UNDER_FRAMES = 30;
+// let smoothed time settle after a change
+static const int COOLDOWN_FRAMES = 10;
+
+void BudgetController::reset(double target_ms, int max_level)
+{
+    this->target_ms = target_ms;
+    this->max_level = std::max(0, max_level);
+    current_level = 0;
+    ema_ms = 0.0;
+    nb_frames = 0;
+    nb_over = 0;
+    nb_under = 0;
+    cooldown = 0;
+}
+
+bool BudgetController::update(double frame_ms)
+{
+    if (target_ms <= 0.0) {
+        return false;
+    }
+
+    nb_frames++;
+    if (nb_frames <= WARMUP_FRAMES) {
+        return false;
+    }
+    ema_ms = nb_frames == WARMUP_FRAMES + 1 ? frame_ms : ema_ms + EMA_ALPHA * (frame_ms - ema_ms);
+
+    if (cooldown > 0) {
+        cooldown--;
+        return false;
+    }
+
+    nb_over = ema_ms > target_ms * OVER_RATIO ? nb_over + 1 : 0;
+    nb_under = ema_ms < target_ms * UNDER_RATIO ? nb_under + 1 : 0;
+
+    int level = current_level;
+    if (nb_over >= OVER_FRAMES) {
+        level = std::min(max_level, current_level + 1);
+    } else if (nb_under >= UNDER_FRAMES) {
+        level = std::max(0, current_level - 1);
+    }
+    if (level == current_level) {
+        return false;
+    }
+
+    current_level = level;
+    nb_over = 0;
+    nb_under = 0;
+    cooldown = COOLDOWN_FRAMES;
+    return true;
+}
+
+};
@@ -0,0 +1,36 @@
+#pragma once
+
+namespace litpression {
+
+// feedback controller choosing a load level so that frame times meet a target,
+// level 0 is full quality and each level above is lighter than the previous one.
+// Frame times are smoothed, and levels change only after several consecutive frames
+// out of a hysteresis band followed by a cooldown, so that load does not oscillate
+class BudgetController
+{
+public:
+    // start over with a new target (in ms) at level 0
+    void reset(double target_ms, int max_level);
+
+    // feed wall time of last frame (in ms), return true if level has changed
+    bool update(double frame_ms);
+
+    int level() const { return current_level; }
+    double smoothed_ms() const { return ema_ms; }
+
+private:
+    double target_ms = 0.0;
+    int max_level = 0;
+    int current_level = 0;
+
+    // exponential moving average of frame times
+    double ema_ms = 0.0;
+    int nb_frames = 0;
+    // consecutive frames over budget or with enough headroom
+    int nb_over = 0;
+    int nb_under = 0;
+    // frames left before level can change again
+    int cooldown = 0;
+};
+
+};
@@ -0,0 +1,71 @@
+#pragma once
+
+#include <algorithm>
+#include <cassert>
+#include <cstddef>
+#include <vector>
+
+namespace litpression {
+
+// marks of elements to delete, applied in a single stable pass
+// (remaining elements keep their order, so painter order of strokes is preserved)
+class DelMarks
+{
+public:
+    // unmark everything, without reallocating once capacity has been reached
+    void reset(size_t size)
+    {
+        marks.assign(size, false);
+        nb_marked = 0;
+        first_marked = size;
+    }
+
+    void mark(size_t i)
+    {
+        assert(i < marks.size());
+        if (marks[i]) {
+            return;
+        }
+        marks[i] = true;
+        nb_marked++;
+        first_marked = std::min(first_marked, i);
+    }
+
+    bool is_marked(size_t i) const
+    {
+        assert(i < marks.size());
+        return marks[i];
+    }
+
+    size_t size() const { return marks.size(); }
+    size_t count() const { return nb_marked; }
+
+    // remove marked elements in place, in O(n)
+    template <typename T>
+    void compact(std::vector<T>& values) const
+    {
+        assert(values.size() == marks.size());
+        if (nb_marked == 0) {
+            return;
+        }
+
+        // elements before first mark stay in place
+        size_t j = first_marked;
+        for (size_t i = first_marked + 1; i < values.size(); i++) {
+            if (!marks[i]) {
+                values[j] = std::move(values[i]);
+                j++;
+            }
+        }
+        assert(j == values.size() - nb_marked);
+        // NB: erase rather than resize, values might not be default constructible
+        values.erase(values.begin() + j, values.end());
+    }
+
+private:
+    std::vector<bool> marks;
+    size_t nb_marked = 0;
+    size_t first_marked = 0;
+};
+
+};
@@ -0,0 +1,64 @@
+#include "flow.hpp"
+#include <opencv2/optflow.hpp>
+
+namespace litpression {
+
+cv::Ptr<cv::DenseOpticalFlow> create_flow_alg(const std::string& name)
+{
+    if (name == "dis") {
+        return cv::DISOpticalFlow::create(cv::DISOpticalFlow::PRESET_MEDIUM);
+    } else if (name == "farneback") {
+        // custom presets to try to make Farneback faster
+        return cv::FarnebackOpticalFlow::create(5, 0.5, true, 13, 7, 7, 1.5);
+    } else if (name == "deep") {
+        return cv::optflow::createOptFlow_DeepFlow();
+    } else if (name == "dualtvl1") {
+        return cv::optflow::createOptFlow_DualTVL1();
+    } else if (name == "simple") {
+        return cv::optflow::createOptFlow_SimpleFlow();
+    }
+    return nullptr;
+}
+
+DISParams dis_preset_params(int preset)
+{
+    // same values as cv::DISOpticalFlow::create
+    switch (preset) {
+    case cv::DISOpticalFlow::PRESET_ULTRAFAST:
+        return { 2, 8, 4, 12, 0 };
+    case cv::DISOpticalFlow::PRESET_FAST:
+        return { 2, 8, 4, 16, 5 };
+    default:
+        return { 1, 12, 3, 25, 5 };
+    }
+}
+
+bool get_dis_params(const cv::Ptr<cv::DenseOpticalFlow>& flow_alg, DISParams& params)
+{
+    auto dis = dynamic_cast<cv::DISOpticalFlow*>(flow_alg.get());
+    if (dis == nullptr) {
+        return false;
+    }
+    params.finest_scale = dis->getFinestScale();
+    params.patch_size = dis->getPatchSize();
+    params.patch_stride = dis->getPatchStride();
+    params.gradient_descent_iterations = dis->getGradientDescentIterations();
+    params.variational_refinement_iterations = dis->getVariationalRefinementIterations();
+    return true;
+}
+
+bool set_dis_params(const cv::Ptr<cv::DenseOpticalFlow>& flow_alg, const DISParams& params)
+{
+    auto dis = dynamic_cast<cv::DISOpticalFlow*>(flow_alg.get());
+    if (dis == nullptr) {
+        return false;
+    }
+    dis->setFinestScale(params.finest_scale);
+    dis->setPatchSize(params.patch_size);
+    dis->setPatchStride(params.patch_stride);
+    dis->setGradientDescentIterations(params.gradient_descent_iterations);
+    dis->setVariationalRefinementIterations(params.variational_refinement_iterations);
+    return true;
+}
+
+};
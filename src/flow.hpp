@@ -0,0 +1,34 @@
+#pragma once
+
+#include <opencv2/opencv.hpp>
+#include <string>
+
+namespace litpression {
+
+// names accepted by create_flow_alg, or LK_FLOW_ALG_NAME
+const char FLOW_ALG_NAMES[] = "dis, farneback, deep, dualtvl1, simple, lk";
+
+// sparse Lucas-Kanade tracking of stroke centers,
+// done by Litpression itself with FlowMode::lk (no dense flow algorithm)
+const char LK_FLOW_ALG_NAME[] = "lk";
+
+// return nullptr if name is unknown or is LK_FLOW_ALG_NAME
+cv::Ptr<cv::DenseOpticalFlow> create_flow_alg(const std::string& name);
+
+// DIS parameters driving its speed, as set by its presets
+struct DISParams
+{
+    int finest_scale;
+    int patch_size;
+    int patch_stride;
+    int gradient_descent_iterations;
+    int variational_refinement_iterations;
+};
+
+// parameters of cv::DISOpticalFlow::PRESET_* preset
+DISParams dis_preset_params(int preset);
+// return false if flow_alg is not DIS
+bool get_dis_params(const cv::Ptr<cv::DenseOpticalFlow>& flow_alg, DISParams& params);
+bool set_dis_params(const cv::Ptr<cv::DenseOpticalFlow>& flow_alg, const DISParams& params);
+
+};
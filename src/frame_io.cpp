@@ -0,0 +1,327 @@
+#include "frame_io.hpp"
+#include <algorithm>
+#include <cstring>
+#include <fcntl.h>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace litpression {
+
+static const char Y4M_MAGIC[] = "YUV4MPEG2";
+static const char Y4M_FRAME[] = "FRAME";
+// headers are short, anything longer is not a y4m stream
+static const size_t Y4M_MAX_LINE = 4096;
+static const char Y4M_FRAME_LINE[] = "FRAME\n";
+// frames of mapped files paged in ahead of reads
+static const size_t READAHEAD_FRAMES = 4;
+
+// read up to newline (excluded), return false at end of stream
+static bool read_line(FILE* file, std::string& line)
+{
+    line.clear();
+    int c;
+    while ((c = std::fgetc(file)) != EOF) {
+        if (c == '\n') {
+            return true;
+        }
+        if (line.size() >= Y4M_MAX_LINE) {
+            return false;
+        }
+        line.push_back((char) c);
+    }
+    return false;
+}
+
+static bool read_exactly(FILE* file, uchar* data, size_t size)
+{
+    return std::fread(data, 1, size, file) == size;
+}
+
+// parameters of y4m stream header (without newline)
+struct Y4MHeader
+{
+    cv::Size size;
+    int fps_num = 0;
+    int fps_den = 1;
+    bool mono = false;
+
+    // bytes of frame planes (after FRAME line)
+    size_t frame_bytes() const { return (size_t) size.area() * (mono ? 2 : 3) / 2; }
+};
+
+// return false if header is invalid (reported to stderr)
+static bool parse_y4m_header(const std::string& line, Y4MHeader& header)
+{
+    std::istringstream params(line);
+    std::string param;
+    if (!(params >> param) || param != Y4M_MAGIC) {
+        std::cerr << "Not a Y4M stream" << std::endl;
+        return false;
+    }
+    // NB: interlacing, aspect ratio and extensions are ignored
+    std::string colorspace = "420jpeg";
+    while (params >> param) {
+        const char* value = param.c_str() + 1;
+        switch (param[0]) {
+        case 'W':
+            header.size.width = std::atoi(value);
+            break;
+        case 'H':
+            header.size.height = std::atoi(value);
+            break;
+        case 'F':
+            if (std::sscanf(value, "%d:%d", &header.fps_num, &header.fps_den) != 2 || header.fps_den <= 0) {
+                header.fps_num = 0;
+                header.fps_den = 1;
+            }
+            break;
+        case 'C':
+            colorspace = value;
+            break;
+        }
+    }
+
+    if (header.size.width <= 0 || header.size.height <= 0) {
+        std::cerr << "Invalid Y4M frame size" << std::endl;
+        return false;
+    }
+    // 8-bit 4:2:0 variants only differ by chroma siting
+    header.mono = colorspace == "mono";
+    bool yuv420 = colorspace == "420jpeg" || colorspace == "420paldv" || colorspace == "420mpeg2" || colorspace == "420";
+    if (!header.mono && !yuv420) {
+        std::cerr << "Unsupported Y4M colorspace: " << colorspace << " (420 or mono expected)" << std::endl;
+        return false;
+    }
+    if (!header.mono && (header.size.width % 2 != 0 || header.size.height % 2 != 0)) {
+        std::cerr << "Y4M 4:2:0 frames must have even width and height" << std::endl;
+        return false;
+    }
+    return true;
+}
+
+// planes of y4m frame to BGR
+static void y4m_to_bgr(const cv::Mat1b& yuv, bool mono, cv::Mat3b& frame)
+{
+    cv::cvtColor(yuv, frame, mono ? cv::COLOR_GRAY2BGR : cv::COLOR_YUV2BGR_I420);
+}
+
+bool PipeReader::open(FILE* file, PipeFormat format, cv::Size size)
+{
+    this->file = file;
+    pipe_format = format;
+    frame_size = size;
+    fps_num = 0;
+    fps_den = 1;
+    mono = false;
+
+    if (format == PipeFormat::raw_bgr24) {
+        if (size.width <= 0 || size.height <= 0) {
+            std::cerr << "Raw frames need a frame size" << std::endl;
+            return false;
+        }
+        return true;
+    }
+
+    std::string line;
+    if (!read_line(file, line)) {
+        std::cerr << "Missing Y4M header" << std::endl;
+        return false;
+    }
+    Y4MHeader header;
+    if (!parse_y4m_header(line, header)) {
+        return false;
+    }
+    frame_size = header.size;
+    fps_num = header.fps_num;
+    fps_den = header.fps_den;
+    mono = header.mono;
+    return true;
+}
+
+bool PipeReader::read(cv::Mat3b& frame)
+{
+    if (file == nullptr) {
+        return false;
+    }
+
+    if (pipe_format == PipeFormat::raw_bgr24) {
+        frame.create(frame_size);
+        return read_exactly(file, frame.data, frame.total() * frame.elemSize());
+    }
+
+    std::string line;
+    if (!read_line(file, line) || line.compare(0, sizeof(Y4M_FRAME) - 1, Y4M_FRAME) != 0) {
+        return false;
+    }
+    // planes are contiguous in stream as in buffer
+    yuv.create(mono ? frame_size.height : frame_size.height * 3 / 2, frame_size.width);
+    if (!read_exactly(file, yuv.data, yuv.total())) {
+        return false;
+    }
+    y4m_to_bgr(yuv, mono, frame);
+    return true;
+}
+
+MappedFrameFile::~MappedFrameFile()
+{
+    if (data != nullptr) {
+        munmap(data, length);
+    }
+}
+
+bool MappedFrameFile::open(const std::string& path, PipeFormat format, cv::Size size)
+{
+    int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0) {
+        std::cerr << "Failed to open file at path: " << path << std::endl;
+        return false;
+    }
+    struct stat st;
+    if (fstat(fd, &st) != 0 || st.st_size == 0) {
+        std::cerr << "Empty file at path: " << path << std::endl;
+        ::close(fd);
+        return false;
+    }
+    length = (size_t) st.st_size;
+    // NB: private writable mapping, so that frames can be handed as non const mats
+    void* addr = mmap(nullptr, length, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+    // (mapping keeps file open)
+    ::close(fd);
+    if (addr == MAP_FAILED) {
+        std::cerr << "Failed to map file at path: " << path << std::endl;
+        length = 0;
+        return false;
+    }
+    data = (uchar*) addr;
+    // kernel reads ahead aggressively and frees pages soon after they are read
+    madvise(data, length, MADV_SEQUENTIAL);
+
+    file_format = format;
+    if (format == PipeFormat::raw_bgr24) {
+        if (size.width <= 0 || size.height <= 0) {
+            std::cerr << "Raw frames need a frame size" << std::endl;
+            return false;
+        }
+        frame_size = size;
+        frames_offset = 0;
+        frame_line = 0;
+        frame_bytes = (size_t) size.area() * 3;
+    } else {
+        const uchar* header_end = (const uchar*) std::memchr(data, '\n', std::min(length, Y4M_MAX_LINE));
+        if (header_end == nullptr) {
+            std::cerr << "Missing Y4M header" << std::endl;
+            return false;
+        }
+        Y4MHeader header;
+        if (!parse_y4m_header(std::string((const char*) data, header_end - data), header)) {
+            return false;
+        }
+        frame_size = header.size;
+        fps_num = header.fps_num;
+        fps_den = header.fps_den;
+        mono = header.mono;
+        frames_offset = header_end + 1 - data;
+        frame_line = sizeof(Y4M_FRAME_LINE) - 1;
+        frame_bytes = header.frame_bytes();
+    }
+
+    // (truncated last frame is ignored)
+    frames_count = (length - frames_offset) / (frame_line + frame_bytes);
+    next_i = (size_t) -1;
+    return true;
+}
+
+void MappedFrameFile::advise_readahead(size_t first_i, size_t end_i)
+{
+    end_i = std::min(end_i, frames_count);
+    if (first_i >= end_i) {
+        return;
+    }
+    size_t stride = frame_line + frame_bytes;
+    // NB: advised range must start on a page boundary
+    size_t page_size = (size_t) sysconf(_SC_PAGESIZE);
+    size_t begin = (frames_offset + first_i * stride) / page_size * page_size;
+    size_t end = frames_offset + end_i * stride;
+    madvise(data + begin, end - begin, MADV_WILLNEED);
+}
+
+bool MappedFrameFile::read(size_t i, cv::Mat3b& frame)
+{
+    if (data == nullptr || i >= frames_count) {
+        return false;
+    }
+
+    // whole window after a seek (or first read), then one more frame per read
+    if (i == next_i) {
+        advise_readahead(i + READAHEAD_FRAMES, i + READAHEAD_FRAMES + 1);
+    } else {
+        advise_readahead(i, i + READAHEAD_FRAMES + 1);
+    }
+    next_i = i + 1;
+
+    uchar* frame_data = data + frames_offset + i * (frame_line + frame_bytes);
+    if (file_format == PipeFormat::raw_bgr24) {
+        frame = cv::Mat3b(frame_size.height, frame_size.width, (cv::Vec3b*) frame_data);
+        return true;
+    }
+
+    if (std::memcmp(frame_data, Y4M_FRAME_LINE, frame_line) != 0) {
+        std::cerr << "Y4M frame " << i << " has parameters or is misplaced, not supported" << std::endl;
+        return false;
+    }
+    cv::Mat1b yuv(mono ? frame_size.height : frame_size.height * 3 / 2, frame_size.width, frame_data + frame_line);
+    y4m_to_bgr(yuv, mono, frame);
+    return true;
+}
+
+void PipeWriter::open(FILE* file, PipeFormat format, int fps_num, int fps_den)
+{
+    this->file = file;
+    pipe_format = format;
+    this->fps_num = fps_num;
+    this->fps_den = fps_den;
+    header_written = false;
+}
+
+bool PipeWriter::write(const cv::Mat3b& frame)
+{
+    if (file == nullptr) {
+        return false;
+    }
+
+    const uchar* data = frame.data;
+    size_t size = frame.total() * frame.elemSize();
+    cv::Mat3b continuous;
+    if (pipe_format == PipeFormat::raw_bgr24) {
+        if (!frame.isContinuous()) {
+            continuous = frame.clone();
+            data = continuous.data;
+        }
+    } else {
+        if (!header_written) {
+            if (frame.cols % 2 != 0 || frame.rows % 2 != 0) {
+                std::cerr << "Y4M 4:2:0 frames must have even width and height" << std::endl;
+                return false;
+            }
+            std::fprintf(file, "%s W%d H%d F%d:%d Ip A1:1 C420jpeg\n", Y4M_MAGIC, frame.cols, frame.rows, fps_num, fps_den);
+            header_written = true;
+        }
+        cv::cvtColor(frame, yuv, cv::COLOR_BGR2YUV_I420);
+        std::fprintf(file, "%s\n", Y4M_FRAME);
+        data = yuv.data;
+        size = yuv.total();
+    }
+
+    // NB: flushed on each frame, so that downstream process is not starved
+    if (std::fwrite(data, 1, size, file) != size || std::fflush(file) != 0) {
+        std::cerr << "Failed to write frame" << std::endl;
+        return false;
+    }
+    return true;
+}
+
+};
@@ -0,0 +1,103 @@
+#pragma once
+
+#include <cstdio>
+#include <opencv2/opencv.hpp>
+#include <string>
+
+namespace litpression {
+
+// frames streamed through pipes (ex: from and to ffmpeg), without highgui nor videoio
+enum class PipeFormat
+{
+    // packed 8-bit BGR frames, frame size given out of band
+    // (ffmpeg -f rawvideo -pix_fmt bgr24)
+    raw_bgr24,
+    // YUV4MPEG2 stream, 4:2:0 or mono
+    // (ffmpeg -f yuv4mpegpipe -pix_fmt yuv420p)
+    y4m,
+};
+
+class PipeReader
+{
+public:
+    // raw_bgr24 needs frame size, y4m reads it from stream header
+    // return false if header is invalid (reported to stderr)
+    bool open(FILE* file, PipeFormat format, cv::Size size = cv::Size());
+    // return false at end of stream (or on truncated frame)
+    bool read(cv::Mat3b& frame);
+
+    PipeFormat format() const { return pipe_format; }
+    cv::Size size() const { return frame_size; }
+    // frame rate from y4m header (0 if unknown)
+    int fps_num = 0;
+    int fps_den = 1;
+
+private:
+    FILE* file = nullptr;
+    PipeFormat pipe_format = PipeFormat::raw_bgr24;
+    cv::Size frame_size;
+    bool mono = false;
+    // planes of y4m frames
+    cv::Mat1b yuv;
+};
+
+// frames of an uncompressed y4m or raw BGR24 file, mapped in memory instead of read,
+// with random access (no decoding, frame i is at a fixed offset)
+// NB: y4m frames with parameters on their FRAME line are not supported
+class MappedFrameFile
+{
+public:
+    MappedFrameFile() = default;
+    ~MappedFrameFile();
+    MappedFrameFile(const MappedFrameFile&) = delete;
+    MappedFrameFile& operator=(const MappedFrameFile&) = delete;
+
+    // raw_bgr24 needs frame size, y4m reads it from file header
+    // return false if file cannot be mapped or header is invalid (reported to stderr)
+    bool open(const std::string& path, PipeFormat format, cv::Size size = cv::Size());
+    // return false past last frame.
+    // Raw frames are headers over mapped pages, without copy, valid while file is open
+    // (pages are private, writing to them does not change file), y4m frames are converted to BGR
+    bool read(size_t i, cv::Mat3b& frame);
+
+    size_t nb_frames() const { return frames_count; }
+    cv::Size size() const { return frame_size; }
+    // frame rate from y4m header (0 if unknown)
+    int fps_num = 0;
+    int fps_den = 1;
+
+private:
+    uchar* data = nullptr;
+    size_t length = 0;
+    PipeFormat file_format = PipeFormat::raw_bgr24;
+    cv::Size frame_size;
+    bool mono = false;
+    // frame i has a FRAME line (y4m only) then planes, starting at frames_offset + i * (frame_line + frame_bytes)
+    size_t frames_offset = 0;
+    size_t frame_line = 0;
+    size_t frame_bytes = 0;
+    size_t frames_count = 0;
+    // frame following last read one, readahead window is only advanced by sequential reads
+    size_t next_i = (size_t) -1;
+
+    void advise_readahead(size_t first_i, size_t end_i);
+};
+
+class PipeWriter
+{
+public:
+    void open(FILE* file, PipeFormat format, int fps_num, int fps_den = 1);
+    // y4m header is written with first frame (once we know frame size)
+    // return false on error (ex: closed pipe), reported to stderr
+    bool write(const cv::Mat3b& frame);
+
+private:
+    FILE* file = nullptr;
+    PipeFormat pipe_format = PipeFormat::raw_bgr24;
+    int fps_num = 0;
+    int fps_den = 1;
+    bool header_written = false;
+    cv::Mat1b yuv;
+};
+
+};
@@ -0,0 +1,147 @@
+#include "front_end.hpp"
+#include <algorithm>
+#include <vector>
+
+namespace litpression {
+
+// fixed point coefficients used by cv::cvtColor
+static const int GRAY_SHIFT = 14;
+static const int B_TO_GRAY = 1868;
+static const int G_TO_GRAY = 9617;
+static const int R_TO_GRAY = 4899;
+
+// typical per-core L2 size
+static const size_t L2_SIZE = 512 * 1024;
+
+// reflect 101 border: -1 -> 1, n -> n - 2
+static inline int reflect_101(int i, int n)
+{
+    if (n == 1) {
+        return 0;
+    }
+    if (i < 0) {
+        return -i;
+    }
+    if (i >= n) {
+        return 2 * n - 2 - i;
+    }
+    return i;
+}
+
+static void gray_row(const uint8_t* __restrict bgr, uint8_t* __restrict gray, int width)
+{
+    for (int x = 0; x < width; x++) {
+        int v = bgr[3 * x] * B_TO_GRAY + bgr[3 * x + 1] * G_TO_GRAY + bgr[3 * x + 2] * R_TO_GRAY;
+        gray[x] = (uint8_t) ((v + (1 << (GRAY_SHIFT - 1))) >> GRAY_SHIFT);
+    }
+}
+
+// 3x3 stencils at x of middle row m, with xl and xr the (reflected) left and right columns
+static inline void stencils_at(const uint8_t* t, const uint8_t* m, const uint8_t* b, int xl, int x, int xr,
+    float* laplacian, float* grad_x, float* grad_y)
+{
+    if (laplacian != nullptr) {
+        laplacian[x] = (float) (t[x] + b[x] + m[xl] + m[xr] - 4 * m[x]);
+    }
+    if (grad_x != nullptr) {
+        grad_x[x] = (float) (3 * (t[xr] - t[xl] + b[xr] - b[xl]) + 10 * (m[xr] - m[xl]));
+        grad_y[x] = (float) (3 * (b[xl] - t[xl] + b[xr] - t[xr]) + 10 * (b[x] - t[x]));
+    }
+}
+
+static void stencils_row(const uint8_t* __restrict t, const uint8_t* __restrict m, const uint8_t* __restrict b,
+    int width, float* __restrict laplacian, float* __restrict grad_x, float* __restrict grad_y)
+{
+    // interior, in separate loops so that each one is vectorized
+    if (laplacian != nullptr) {
+        for (int x = 1; x < width - 1; x++) {
+            laplacian[x] = (float) (t[x] + b[x] + m[x - 1] + m[x + 1] - 4 * m[x]);
+        }
+    }
+    if (grad_x != nullptr) {
+        for (int x = 1; x < width - 1; x++) {
+            grad_x[x] = (float) (3 * (t[x + 1] - t[x - 1] + b[x + 1] - b[x - 1]) + 10 * (m[x + 1] - m[x - 1]));
+        }
+        for (int x = 1; x < width - 1; x++) {
+            grad_y[x] = (float) (3 * (b[x - 1] - t[x - 1] + b[x + 1] - t[x + 1]) + 10 * (b[x] - t[x]));
+        }
+    }
+
+    // borders
+    stencils_at(t, m, b, reflect_101(-1, width), 0, reflect_101(1, width), laplacian, grad_x, grad_y);
+    if (width > 1) {
+        stencils_at(t, m, b, width - 2, width - 1, reflect_101(width, width), laplacian, grad_x, grad_y);
+    }
+}
+
+void front_end_rows(const FrontEndBuffers& bufs, int width, int height, int y0, int y1)
+{
+    // gray of rows above and below band
+    static thread_local std::vector<uint8_t> halo;
+    halo.resize(2 * (size_t) width);
+
+    // gray given as input, no row is written
+    bool gray_ready = bufs.bgr == nullptr;
+
+    auto gray_row_at = [&](int y) -> const uint8_t* {
+        y = reflect_101(y, height);
+        if (gray_ready || (y >= y0 && y < y1)) {
+            return bufs.gray + y * bufs.gray_step;
+        }
+        return halo.data() + (y < y0 ? 0 : width);
+    };
+
+    if (!gray_ready) {
+        int y_above = reflect_101(y0 - 1, height);
+        if (y_above < y0 || y_above >= y1) {
+            gray_row(bufs.bgr + y_above * bufs.bgr_step, halo.data() + (y_above < y0 ? 0 : width), width);
+        }
+        int y_below = reflect_101(y1, height);
+        if (y_below < y0 || y_below >= y1) {
+            gray_row(bufs.bgr + y_below * bufs.bgr_step, halo.data() + (y_below < y0 ? 0 : width), width);
+        }
+        gray_row(bufs.bgr + y0 * bufs.bgr_step, bufs.gray + y0 * bufs.gray_step, width);
+    }
+
+    bool with_stencils = bufs.laplacian != nullptr || bufs.grad_x != nullptr;
+
+    for (int y = y0; y < y1; y++) {
+        // keep gray one row ahead of stencils
+        if (!gray_ready && y + 1 < y1) {
+            gray_row(bufs.bgr + (y + 1) * bufs.bgr_step, bufs.gray + (y + 1) * bufs.gray_step, width);
+        }
+        if (!with_stencils) {
+            continue;
+        }
+
+        float* laplacian = nullptr;
+        if (bufs.laplacian != nullptr) {
+            laplacian = (float*) ((uint8_t*) bufs.laplacian + y * bufs.laplacian_step);
+        }
+        float* grad_x = nullptr;
+        float* grad_y = nullptr;
+        if (bufs.grad_x != nullptr) {
+            grad_x = (float*) ((uint8_t*) bufs.grad_x + y * bufs.grad_step);
+            grad_y = (float*) ((uint8_t*) bufs.grad_y + y * bufs.grad_step);
+        }
+
+        stencils_row(gray_row_at(y - 1), gray_row_at(y), gray_row_at(y + 1), width, laplacian, grad_x, grad_y);
+    }
+}
+
+int front_end_band_rows(const FrontEndBuffers& bufs, int width)
+{
+    size_t row_size = 3 + 1;
+    if (bufs.laplacian != nullptr) {
+        row_size += sizeof(float);
+    }
+    if (bufs.grad_x != nullptr) {
+        row_size += 2 * sizeof(float);
+    }
+    row_size *= std::max(1, width);
+
+    // at least a few rows so that overhead of halo rows stays small
+    return std::max(16, (int) (L2_SIZE / row_size));
+}
+
+};
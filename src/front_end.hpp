@@ -0,0 +1,35 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+namespace litpression {
+
+// buffers of per-pixel front end, steps are in bytes
+struct FrontEndBuffers
+{
+    // input BGR image, null if gray is already computed
+    const uint8_t* bgr = nullptr;
+    size_t bgr_step = 0;
+    uint8_t* gray = nullptr;
+    size_t gray_step = 0;
+    // Laplacian of gray, skipped if null
+    float* laplacian = nullptr;
+    size_t laplacian_step = 0;
+    // Scharr gradients of gray, skipped if null
+    float* grad_x = nullptr;
+    float* grad_y = nullptr;
+    size_t grad_step = 0;
+};
+
+// convert rows [y0, y1) of BGR image to gray (same as cv::cvtColor)
+// and compute Laplacian (same as cv::Laplacian with ksize 1) and Scharr gradients (same as cv::Scharr)
+// of these rows in a single pass, while gray rows are still in cache.
+// Gray rows just outside [y0, y1) are recomputed in a scratch buffer rather than read from bufs.gray,
+// so that disjoint bands of rows can be processed concurrently.
+void front_end_rows(const FrontEndBuffers& bufs, int width, int height, int y0, int y1);
+
+// number of rows of bands whose buffers fit in L2 cache
+int front_end_band_rows(const FrontEndBuffers& bufs, int width);
+
+};
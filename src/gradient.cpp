@@ -0,0 +1,112 @@
+#include "gradient.hpp"
+#include <cmath>
+
+namespace litpression {
+
+static const float TWO_PI = 6.283185307f;
+static const size_t PREFETCH_DISTANCE = 16;
+
+// reflect 101 border: -1 -> 1, n -> n - 2
+static inline int reflect_101(int i, int n)
+{
+    if (n == 1) {
+        return 0;
+    }
+    if (i < 0) {
+        return -i;
+    }
+    if (i >= n) {
+        return 2 * n - 2 - i;
+    }
+    return i;
+}
+
+// compare squared magnitudes, no sqrt needed
+static inline float mag_thresh_sq(float mag_thresh)
+{
+    return mag_thresh >= 0.0f ? mag_thresh * mag_thresh : -1.0f;
+}
+
+// return true if theta has been updated
+static inline bool orient_with_gradient(float gx, float gy, float mag_thresh_sq, float angle_offset, float& theta)
+{
+    if (gx * gx + gy * gy <= mag_thresh_sq) {
+        return false;
+    }
+    // atan2 only for strokes actually reoriented
+    float angle = std::atan2(gy, gx);
+    if (angle < 0.0f) {
+        angle += TWO_PI;
+    }
+    theta = angle + angle_offset;
+    return true;
+}
+
+size_t orient_with_sparse_gradients(const uint8_t* img, size_t step, int width, int height,
+    const int* xs, const int* ys, size_t n, float mag_thresh, float angle_offset, float* thetas)
+{
+    float thresh_sq = mag_thresh_sq(mag_thresh);
+
+    size_t nb_updated = 0;
+    for (size_t i = 0; i < n; i++) {
+        int x = xs[i];
+        int y = ys[i];
+
+        // strokes are in random order, prefetch neighborhoods of upcoming ones
+        if (i + PREFETCH_DISTANCE < n) {
+            const uint8_t* p = img + ys[i + PREFETCH_DISTANCE] * step + xs[i + PREFETCH_DISTANCE];
+            __builtin_prefetch(p - step);
+            __builtin_prefetch(p);
+            __builtin_prefetch(p + step);
+        }
+
+        // offsets of neighbors columns and rows
+        int x_l, x_r;
+        const uint8_t *row_t, *row_m, *row_b;
+        if (x > 0 && x < width - 1 && y > 0 && y < height - 1) {
+            x_l = x - 1;
+            x_r = x + 1;
+            row_m = img + y * step;
+            row_t = row_m - step;
+            row_b = row_m + step;
+        } else {
+            x_l = reflect_101(x - 1, width);
+            x_r = reflect_101(x + 1, width);
+            row_t = img + reflect_101(y - 1, height) * step;
+            row_m = img + y * step;
+            row_b = img + reflect_101(y + 1, height) * step;
+        }
+
+        int tl = row_t[x_l], t = row_t[x], tr = row_t[x_r];
+        int ml = row_m[x_l], mr = row_m[x_r];
+        int bl = row_b[x_l], b = row_b[x], br = row_b[x_r];
+
+        // [-3 0 3; -10 0 10; -3 0 3] and its transpose
+        float gx = (float) (3 * (tr - tl + br - bl) + 10 * (mr - ml));
+        float gy = (float) (3 * (bl - tl + br - tr) + 10 * (b - t));
+
+        if (orient_with_gradient(gx, gy, thresh_sq, angle_offset, thetas[i])) {
+            nb_updated++;
+        }
+    }
+    return nb_updated;
+}
+
+size_t orient_with_gradients(const float* grad_x, const float* grad_y, size_t step,
+    const int* xs, const int* ys, size_t n, float mag_thresh, float angle_offset, float* thetas)
+{
+    float thresh_sq = mag_thresh_sq(mag_thresh);
+
+    size_t nb_updated = 0;
+    for (size_t i = 0; i < n; i++) {
+        size_t offset = ys[i] * step + xs[i] * sizeof(float);
+        float gx = *(const float*) ((const uint8_t*) grad_x + offset);
+        float gy = *(const float*) ((const uint8_t*) grad_y + offset);
+        if (orient_with_gradient(gx, gy, thresh_sq, angle_offset, thetas[i])) {
+            nb_updated++;
+        }
+    }
+    return nb_updated;
+}
+
+};
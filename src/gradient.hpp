@@ -0,0 +1,21 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+namespace litpression {
+
+// 3x3 Scharr gradient of 8-bit image evaluated at given pixels only,
+// same as cv::Scharr with default border (reflect 101) followed by cv::cartToPolar.
+// thetas[i] is set to gradient angle (in [0, 2 pi)) plus angle_offset
+// where gradient magnitude is greater than mag_thresh, and left untouched elsewhere.
+// Return number of updated thetas.
+size_t orient_with_sparse_gradients(const uint8_t* img, size_t step, int width, int height,
+    const int* xs, const int* ys, size_t n, float mag_thresh, float angle_offset, float* thetas);
+
+// same as orient_with_sparse_gradients, with gradients already computed on whole image
+// (rows of grad_x and grad_y are step bytes apart)
+size_t orient_with_gradients(const float* grad_x, const float* grad_y, size_t step,
+    const int* xs, const int* ys, size_t n, float mag_thresh, float angle_offset, float* thetas);
+
+};
@@ -0,0 +1,145 @@
+#include "grid.hpp"
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+#include <cstdint>
+
+namespace litpression {
+
+void DensityGrid::build(const float* xs, const float* ys, size_t nb_points, float cell_size, int width, int height)
+{
+    assert(cell_size > 0.0f);
+
+    this->xs = xs;
+    this->ys = ys;
+    this->cell_size = cell_size;
+    this->width = width;
+    this->height = height;
+    cell_size_inv = 1.0f / cell_size;
+    nb_cells_x = std::max(1, (int) std::ceil(width * cell_size_inv));
+    nb_cells_y = std::max(1, (int) std::ceil(height * cell_size_inv));
+
+    // counting sort of points by cell
+    size_t nb_cells = (size_t) nb_cells_x * nb_cells_y;
+    cell_starts.assign(nb_cells + 1, 0);
+    for (size_t i = 0; i < nb_points; i++) {
+        int c = cell_y(ys[i]) * nb_cells_x + cell_x(xs[i]);
+        cell_starts[c + 1]++;
+    }
+    for (size_t c = 0; c < nb_cells; c++) {
+        cell_starts[c + 1] += cell_starts[c];
+    }
+
+    cell_points.resize(nb_points);
+    cell_cursors.assign(cell_starts.begin(), cell_starts.end() - 1);
+    for (size_t i = 0; i < nb_points; i++) {
+        int c = cell_y(ys[i]) * nb_cells_x + cell_x(xs[i]);
+        cell_points[cell_cursors[c]++] = i;
+    }
+}
+
+void DensityGrid::fill_holes(float radius, std::mt19937& rng, std::vector<float>& xs_new, std::vector<float>& ys_new)
+{
+    assert(radius <= cell_size);
+    float radius_sq = radius * radius;
+
+    // sampling cells are small enough to hold at most one new point
+    float fill_cell_size = radius / std::sqrt(2.0f);
+    int nb_fill_cells_x = std::max(1, (int) std::ceil((width - 1) / fill_cell_size));
+    int nb_fill_cells_y = std::max(1, (int) std::ceil((height - 1) / fill_cell_size));
+
+    // cheap generator seeded once from rng, sampling draws one number per candidate
+    uint32_t state = (uint32_t) rng() | 1u;
+    auto rand_next = [&state]() {
+        // xorshift32
+        state ^= state << 13;
+        state ^= state >> 17;
+        state ^= state << 5;
+        return state;
+    };
+    const float rand_scale = 1.0f / 65536.0f;
+
+    // one candidate per sampling cell, kept only if far from existing points
+    fill_cells.clear();
+    fill_candidates.clear();
+    for (int cy = 0; cy < nb_fill_cells_y; cy++) {
+        for (int cx = 0; cx < nb_fill_cells_x; cx++) {
+            uint32_t r = rand_next();
+            float x = std::min(width - 1.0f, (cx + (r & 0xffff) * rand_scale) * fill_cell_size);
+            float y = std::min(height - 1.0f, (cy + (r >> 16) * rand_scale) * fill_cell_size);
+            if (is_far_from_points(x, y, radius_sq)) {
+                fill_cells.push_back(cy * nb_fill_cells_x + cx);
+                fill_candidates.push_back(x);
+                fill_candidates.push_back(y);
+            }
+        }
+    }
+
+    // accept candidates in random order to avoid scanline patterns
+    fill_cell_points.assign((size_t) nb_fill_cells_x * nb_fill_cells_y, -1);
+    std::vector<int>& order = fill_cells;
+    for (size_t k = 0; k < order.size(); k++) {
+        size_t l = k + rand_next() % (order.size() - k);
+        std::swap(order[k], order[l]);
+        std::swap(fill_candidates[k * 2], fill_candidates[l * 2]);
+        std::swap(fill_candidates[k * 2 + 1], fill_candidates[l * 2 + 1]);
+
+        int c = order[k];
+        int cx = c % nb_fill_cells_x;
+        int cy = c / nb_fill_cells_x;
+        float x = fill_candidates[k * 2];
+        float y = fill_candidates[k * 2 + 1];
+
+        // accepted points are at least radius apart, so within 2 sampling cells
+        bool far = true;
+        for (int ncy = std::max(0, cy - 2); ncy <= std::min(nb_fill_cells_y - 1, cy + 2) && far; ncy++) {
+            for (int ncx = std::max(0, cx - 2); ncx <= std::min(nb_fill_cells_x - 1, cx + 2) && far; ncx++) {
+                int p = fill_cell_points[ncy * nb_fill_cells_x + ncx];
+                if (p < 0) {
+                    continue;
+                }
+                float dx = xs_new[p] - x;
+                float dy = ys_new[p] - y;
+                far = dx * dx + dy * dy >= radius_sq;
+            }
+        }
+
+        if (far) {
+            fill_cell_points[c] = (int) xs_new.size();
+            xs_new.push_back(x);
+            ys_new.push_back(y);
+        }
+    }
+}
+
+int DensityGrid::cell_x(float x) const
+{
+    return std::max(0, std::min(nb_cells_x - 1, (int) (x * cell_size_inv)));
+}
+
+int DensityGrid::cell_y(float y) const
+{
+    return std::max(0, std::min(nb_cells_y - 1, (int) (y * cell_size_inv)));
+}
+
+bool DensityGrid::is_far_from_points(float x, float y, float dist_sq) const
+{
+    int cx = cell_x(x);
+    int cy = cell_y(y);
+    for (int ncy = std::max(0, cy - 1); ncy <= std::min(nb_cells_y - 1, cy + 1); ncy++) {
+        for (int ncx = std::max(0, cx - 1); ncx <= std::min(nb_cells_x - 1, cx + 1); ncx++) {
+            int c = ncy * nb_cells_x + ncx;
+            for (size_t k = cell_starts[c]; k < cell_starts[c + 1]; k++) {
+                size_t i = cell_points[k];
+                float dx = xs[i] - x;
+                float dy = ys[i] - y;
+                if (dx * dx + dy * dy < dist_sq) {
+                    return false;
+                }
+            }
+        }
+    }
+    return true;
+}
+
+};
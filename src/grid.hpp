@@ -0,0 +1,97 @@
+#pragma once
+
+#include <cstddef>
+#include <random>
+#include <vector>
+
+namespace litpression {
+
+// uniform grid bucketing of points, for neighbor queries in O(1) expected time
+class DensityGrid
+{
+public:
+    // bucket points of [0, width) x [0, height) into square cells
+    // (points slightly outside are clamped to border cells)
+    void build(const float* xs, const float* ys, size_t nb_points, float cell_size, int width, int height);
+
+    // call f(i, j) once for each pair of points closer than sqrt(dist_sq)
+    // (dist_sq must not be greater than squared cell size)
+    template <typename F>
+    void for_each_close_pair(float dist_sq, F f) const;
+
+    // Poisson-disk sampling of points farther than radius from bucketed points and from each other,
+    // coordinates of new points are appended to xs_new and ys_new
+    // (radius must not be greater than cell size)
+    void fill_holes(float radius, std::mt19937& rng, std::vector<float>& xs_new, std::vector<float>& ys_new);
+
+private:
+    const float* xs = nullptr;
+    const float* ys = nullptr;
+    float cell_size = 1.0f;
+    float cell_size_inv = 1.0f;
+    int width = 0;
+    int height = 0;
+    int nb_cells_x = 0;
+    int nb_cells_y = 0;
+
+    // indices of points of cell c are cell_points[cell_starts[c]:cell_starts[c + 1]]
+    std::vector<size_t> cell_starts;
+    std::vector<size_t> cell_points;
+    std::vector<size_t> cell_cursors;
+
+    // scratch buffers for hole filling
+    std::vector<int> fill_cells;
+    std::vector<float> fill_candidates;
+    // index of new point in each sampling cell, or -1
+    std::vector<int> fill_cell_points;
+
+    int cell_x(float x) const;
+    int cell_y(float y) const;
+    bool is_far_from_points(float x, float y, float dist_sq) const;
+};
+
+template <typename F>
+void DensityGrid::for_each_close_pair(float dist_sq, F f) const
+{
+    // half stencil, so that each pair of cells is visited once
+    const int stencil[4][2] = { { 1, -1 }, { 1, 0 }, { 1, 1 }, { 0, 1 } };
+
+    for (int cy = 0; cy < nb_cells_y; cy++) {
+        for (int cx = 0; cx < nb_cells_x; cx++) {
+            int c = cy * nb_cells_x + cx;
+            for (size_t k = cell_starts[c]; k < cell_starts[c + 1]; k++) {
+                size_t i = cell_points[k];
+
+                // same cell
+                for (size_t l = k + 1; l < cell_starts[c + 1]; l++) {
+                    size_t j = cell_points[l];
+                    float dx = xs[i] - xs[j];
+                    float dy = ys[i] - ys[j];
+                    if (dx * dx + dy * dy < dist_sq) {
+                        f(i, j);
+                    }
+                }
+
+                // neighbor cells
+                for (const auto& offset : stencil) {
+                    int ncx = cx + offset[0];
+                    int ncy = cy + offset[1];
+                    if (ncx < 0 || ncx >= nb_cells_x || ncy < 0 || ncy >= nb_cells_y) {
+                        continue;
+                    }
+                    int nc = ncy * nb_cells_x + ncx;
+                    for (size_t l = cell_starts[nc]; l < cell_starts[nc + 1]; l++) {
+                        size_t j = cell_points[l];
+                        float dx = xs[i] - xs[j];
+                        float dy = ys[i] - ys[j];
+                        if (dx * dx + dy * dy < dist_sq) {
+                            f(i, j);
+                        }
+                    }
+                }
+            }
+        }
+    }
+}
+
+};
@@ -1,78 +1,473 @@
 #include "litpression.hpp"
+#include "advect.hpp"
+#include "front_end.hpp"
+#include "gradient.hpp"
 #include "triangle_wrapper.hpp"
 #include <algorithm>
 #include <cassert>
+#include <cmath>
 #include <cstdint>
+#include <future>
+#include <iostream>
 #include <random>
 
 namespace litpression {
 
 using std::vector;
 
+// load levels of frame time budget, each one multiplies stroke areas and spacing by this factor
+static const int BUDGET_MAX_LEVEL = 8;
+static const double BUDGET_LEVEL_AREA_FACTOR = 1.25;
+// DIS presets switched to from these levels
+static const int BUDGET_DIS_FAST_LEVEL = 3;
+static const int BUDGET_DIS_ULTRAFAST_LEVEL = 6;
+
+// frames allowed to allocate buffers when check_frame_buffers is set
+// (first frames, and frames right after a budget level change as flow buffers may be resized)
+static const int ALLOC_CHECK_WARMUP_FRAMES = 3;
+
+const char* density_backend_name(DensityBackend backend)
+{
+    switch (backend) {
+    case DensityBackend::triangle:
+        return "triangle";
+    case DensityBackend::mesh:
+        return "mesh";
+    case DensityBackend::grid:
+        return "grid";
+    }
+    return "unknown";
+}
+
+bool density_backend_from_name(const std::string& name, DensityBackend& backend)
+{
+    for (auto b : { DensityBackend::triangle, DensityBackend::mesh, DensityBackend::grid }) {
+        if (name == density_backend_name(b)) {
+            backend = b;
+            return true;
+        }
+    }
+    return false;
+}
+
+// single pass over bands of rows fitting in cache, bands processed in parallel
+static void run_front_end(const FrontEndBuffers& bufs, int width, int height)
+{
+    int band_rows = front_end_band_rows(bufs, width);
+    int nb_bands = (height + band_rows - 1) / band_rows;
+    cv::parallel_for_(cv::Range(0, nb_bands), [&](const cv::Range& range) {
+        for (int b = range.start; b < range.end; b++) {
+            front_end_rows(bufs, width, height, b * band_rows, std::min(height, (b + 1) * band_rows));
+        }
+    });
+}
+
 cv::Mat3b Litpression::process(const cv::Mat3b& color)
 {
-    this->color = color.clone();
+    begin_alloc_check();
+    // NB: before any flow computation, as it may change flow parameters
+    adapt_to_budget();
+
+    stats.begin_frame();
+    {
+        StageTimer timer(stats, Stage::total);
+        process_frame(color);
+    }
+    stats.end_frame();
+    end_alloc_check();
+
+    return out;
+}
+
+cv::Mat3b Litpression::process_pipelined(const cv::Mat3b& color)
+{
+    if (!has_pending) {
+        // nothing to render until flow with next frame can be computed
+        compute_gray(color, gray);
+        color.copyTo(color_pending);
+        has_pending = true;
+        return cv::Mat3b();
+    }
+
+    begin_alloc_check();
+    stats.begin_frame();
+    {
+        StageTimer timer(stats, Stage::total);
+
+        // flow between previous and pending frames
+        wait_flow();
+        // NB: no flow task running
+        adapt_to_budget();
+
+        // start flow between pending and new frames, computed while pending frame is rendered
+        compute_gray(color, gray_next);
+        if (settings.flow_mode == FlowMode::dense) {
+            flow_next.create(flow_size(gray.size()));
+        }
+        // NB: task works on its own headers, so members can be swapped while it runs
+        cv::Mat1b flow_from = gray;
+        cv::Mat1b flow_to = gray_next;
+        cv::Mat2f flow_dst = flow_next;
+        flow_task = std::async(std::launch::async, [this, flow_from, flow_to, flow_dst]() mutable {
+            if (settings.flow_mode == FlowMode::lk) {
+                // strokes of pending frame are not moved yet, only pyramid can be built ahead
+                build_pyramid(flow_to, pyramid_next);
+            } else if (settings.flow_downscale > 1) {
+                // downscaled "to" frame is reused as "from" frame of next task
+                if (gray_flow_from.empty()) {
+                    downscale_for_flow(flow_from, gray_flow_from);
+                }
+                downscale_for_flow(flow_to, gray_flow_to);
+                flow_alg->calc(gray_flow_from, gray_flow_to, flow_dst);
+                cv::swap(gray_flow_from, gray_flow_to);
+            } else {
+                flow_alg->calc(flow_from, flow_to, flow_dst);
+            }
+        });
+
+        process_frame(color_pending, true);
+
+        // NB: pending frame buffer is free once rendered
+        color.copyTo(color_pending);
+        cv::swap(gray, gray_next);
+    }
+    stats.end_frame();
+    end_alloc_check();
+
+    return out;
+}
+
+cv::Mat3b Litpression::flush()
+{
+    if (!has_pending) {
+        return cv::Mat3b();
+    }
+
+    begin_alloc_check();
+    stats.begin_frame();
+    {
+        StageTimer timer(stats, Stage::total);
+        wait_flow();
+        process_frame(color_pending, true);
+    }
+    stats.end_frame();
+    end_alloc_check();
+
+    has_pending = false;
+    color_pending.release();
+    return out;
+}
+
+void Litpression::reset()
+{
+    // NB: last frame may not have been flushed
+    if (flow_task.valid()) {
+        flow_task.get();
+    }
+    if (budget_started) {
+        settings = budget_base;
+        if (has_dis_base) {
+            set_dis_params(flow_alg, dis_base);
+        }
+        budget_started = false;
+    }
+
+    first_frame = true;
+    has_pending = false;
+    pyramid_ready = false;
+    // downscaled frame kept by flow task belongs to previous stream
+    gray_flow_from.release();
+    strokes.clear();
+    strokes_new.clear();
+    stats = Stats();
+    alloc_warmup_start = 0;
+}
+
+void Litpression::wait_flow()
+{
+    if (!flow_task.valid()) {
+        return;
+    }
+
+    // NB: only time not overlapped with rendering is measured
+    StageTimer timer(stats, Stage::flow);
+    flow_task.get();
+    if (settings.flow_mode == FlowMode::lk) {
+        std::swap(pyramid, pyramid_next);
+        pyramid_ready = true;
+    } else {
+        cv::swap(flow, flow_next);
+    }
+}
+
+void Litpression::begin_alloc_check()
+{
+    if (!settings.check_frame_buffers) {
+        return;
+    }
+    enable_alloc_counter();
+    alloc_counts_begin = alloc_counts();
+    nb_new_out_buffers = 0;
+}
+
+void Litpression::end_alloc_check()
+{
+    if (!settings.check_frame_buffers) {
+        return;
+    }
+    AllocCounts counts = alloc_counts();
+    frame_allocs.mats = counts.mats - alloc_counts_begin.mats;
+    frame_allocs.news = counts.news - alloc_counts_begin.news;
+
+    if (stats.nb_frames() <= alloc_warmup_start + ALLOC_CHECK_WARMUP_FRAMES) {
+        return;
+    }
+    // NB: more output buffers are needed while callers keep more rendered frames, not a steady state allocation
+    size_t nb_frame_buffers = frame_allocs.mats - nb_new_out_buffers;
+    if (nb_frame_buffers > 0) {
+        std::cerr << "Frame " << stats.nb_frames() << ": " << nb_frame_buffers << " frame buffers allocated after warm-up ("
+                  << frame_allocs.news << " operator new calls)" << std::endl;
+        exit(EXIT_FAILURE);
+    }
+}
+
+void Litpression::adapt_to_budget()
+{
+    if (settings.target_frame_ms <= 0) {
+        return;
+    }
+
+    if (!budget_started) {
+        budget_base = settings;
+        has_dis_base = get_dis_params(flow_alg, dis_base);
+        budget.reset(settings.target_frame_ms, BUDGET_MAX_LEVEL);
+        budget_started = true;
+    }
+
+    // time of previous process call, if any
+    if (stats.nb_frames() == 0) {
+        return;
+    }
+    if (budget.update(stats.last(Stage::total))) {
+        apply_budget_level(budget.level());
+        alloc_warmup_start = stats.nb_frames();
+    }
+}
+
+void Litpression::apply_budget_level(int level)
+{
+    // fewer larger strokes: areas and squared distances scale with factor, lengths with its square root
+    double area_factor = std::pow(BUDGET_LEVEL_AREA_FACTOR, level);
+    double length_factor = std::sqrt(area_factor);
+    const Settings& base = budget_base;
+
+    settings.max_triangle_area = (int) std::lround(base.max_triangle_area * area_factor);
+    settings.min_dist_sq = (int) std::lround(base.min_dist_sq * area_factor);
+    settings.min_triangle_area = (int) std::lround(base.min_triangle_area * area_factor);
+    settings.min_radius = std::max(1, (int) std::lround(base.min_radius * length_factor));
+    settings.max_radius = std::max(1, (int) std::lround(base.max_radius * length_factor));
+    settings.min_length = std::max(1, (int) std::lround(base.min_length * length_factor));
+    settings.max_length = std::max(1, (int) std::lround(base.max_length * length_factor));
+
+    if (has_dis_base) {
+        if (level >= BUDGET_DIS_ULTRAFAST_LEVEL) {
+            set_dis_params(flow_alg, dis_preset_params(cv::DISOpticalFlow::PRESET_ULTRAFAST));
+        } else if (level >= BUDGET_DIS_FAST_LEVEL) {
+            set_dis_params(flow_alg, dis_preset_params(cv::DISOpticalFlow::PRESET_FAST));
+        } else {
+            set_dis_params(flow_alg, dis_base);
+        }
+    }
+}
+
+void Litpression::compute_gray(const cv::Mat3b& color, cv::Mat1b& gray)
+{
+    gray.create(color.size());
+
+    FrontEndBuffers bufs;
+    bufs.bgr = color.ptr<uint8_t>();
+    bufs.bgr_step = color.step;
+    bufs.gray = gray.ptr<uint8_t>();
+    bufs.gray_step = gray.step;
+    run_front_end(bufs, color.cols, color.rows);
+}
+
+cv::Size Litpression::flow_size(const cv::Size& size) const
+{
+    int s = std::max(1, settings.flow_downscale);
+    return cv::Size((size.width + s - 1) / s, (size.height + s - 1) / s);
+}
+
+void Litpression::downscale_for_flow(const cv::Mat1b& gray, cv::Mat1b& gray_flow) const
+{
+    if (settings.flow_downscale <= 1) {
+        gray_flow = gray;
+        return;
+    }
+    // NB: area interpolation averages pixels, which also denoises flow input
+    cv::resize(gray, gray_flow, flow_size(gray.size()), 0, 0, cv::INTER_AREA);
+}
+
+void Litpression::build_pyramid(const cv::Mat1b& gray, vector<cv::Mat>& pyramid) const
+{
+    // NB: gray buffers are overwritten by next frames, pyramid must not reference them
+    cv::buildOpticalFlowPyramid(gray, pyramid, cv::Size(settings.lk_win_size, settings.lk_win_size),
+        settings.lk_max_level, true, cv::BORDER_REFLECT_101, cv::BORDER_CONSTANT, false);
+}
+
+void Litpression::process_frame(const cv::Mat3b& color, bool pipelined)
+{
+    // NB: pending frames are already copies
+    if (pipelined) {
+        this->color = color;
+    } else {
+        color.copyTo(this->color);
+    }
 
     if (first_frame) {
         width = color.size().width;
         height = color.size().height;
+        // same strokes for same stream, whatever streams were processed before (see reset)
+        rng.seed(settings.seed);
         corners = {
             cv::Point2f(0, 0),
             cv::Point2f(width - 1.0f, 0.0f),
             cv::Point2f(0.0f, height - 1.0f),
             cv::Point2f(width - 1.0f, height - 1.0f)
         };
-        flow = cv::Mat::zeros(height, width, CV_32FC2);
+        if (settings.flow_mode == FlowMode::dense) {
+            flow = cv::Mat::zeros(flow_size(color.size()), CV_32FC2);
+        }
+        // output buffers of a previous stream (see reset) only fit frames of same size
+        if (!out_buffers.empty() && out_buffers.front().size() != color.size()) {
+            out_buffers.clear();
+        }
     }
     // gray needed for contours and optical flow
-    cv::cvtColor(color, gray, cv::COLOR_BGR2GRAY);
-
-    if (settings.clip_thresh > 0) {
-        compute_contours();
+    {
+        StageTimer timer(stats, Stage::front_end);
+        // gray of pending frames has been computed for flow
+        compute_front_end(pipelined);
+        if (!pipelined && settings.flow_mode == FlowMode::dense) {
+            downscale_for_flow(gray, gray_flow);
+        }
+    }
+    // pyramid of pending frames has been built by flow task
+    if (settings.flow_mode == FlowMode::lk && !pyramid_ready) {
+        StageTimer timer(stats, Stage::flow);
+        build_pyramid(gray, pyramid);
     }
 
     if (first_frame) {
-        gen_initial_strokes();
+        if (settings.density_backend == DensityBackend::mesh) {
+            // margin so that all strokes centers are strictly inside mesh bounds
+            mesh.reset(-1.0, -1.0, width, height);
+        } else if (settings.density_backend == DensityBackend::triangle) {
+            StageTimer timer(stats, Stage::triangulate);
+            triangulate();
+        }
+        {
+            StageTimer timer(stats, Stage::gen_new_strokes);
+            gen_initial_strokes();
+        }
     } else {
-        flow_alg->calc(gray_prev, gray, flow);
-        move_strokes();
-        del_strokes_too_close();
-        gen_new_strokes();
+        if (!pipelined && settings.flow_mode == FlowMode::dense) {
+            StageTimer timer(stats, Stage::flow);
+            flow_alg->calc(gray_prev, gray_flow, flow);
+        }
+        {
+            StageTimer timer(stats, Stage::move_strokes);
+            move_strokes();
+        }
+        {
+            StageTimer timer(stats, Stage::del_strokes_too_close);
+            del_strokes_too_close();
+        }
+        if (settings.density_backend == DensityBackend::triangle) {
+            // NB: after too close strokes are deleted, so that refinement only sees remaining strokes
+            {
+                StageTimer timer(stats, Stage::triangulate);
+                triangulate();
+            }
+            StageTimer timer(stats, Stage::del_strokes_too_close);
+            del_strokes_in_small_triangles();
+        }
+        {
+            StageTimer timer(stats, Stage::gen_new_strokes);
+            gen_new_strokes();
+        }
     }
 
     if (settings.gradient_orientation) {
+        StageTimer timer(stats, Stage::orient_strokes);
         orient_strokes_with_gradients();
     }
 
-    clip_strokes();
-    draw_strokes();
+    {
+        StageTimer timer(stats, Stage::clip_strokes);
+        clip_strokes();
+    }
+    {
+        StageTimer timer(stats, Stage::draw_strokes);
+        draw_strokes();
+    }
 
-    gray_prev = gray.clone();
+    if (settings.flow_mode == FlowMode::lk) {
+        std::swap(pyramid_prev, pyramid);
+        pyramid_ready = false;
+    } else if (!pipelined) {
+        // ping-pong, gray buffer of previous frame is overwritten by next frame
+        if (settings.flow_downscale > 1) {
+            // downscaled buffer is not shared with gray
+            cv::swap(gray_prev, gray_flow);
+        } else {
+            cv::swap(gray_prev, gray);
+        }
+    }
     first_frame = false;
-
-    return out;
 }
 
-void Litpression::compute_contours()
+void Litpression::compute_front_end(bool gray_ready)
 {
-    // int blur_size = 11;
-    // cv::Mat blur, grad_x, grad_y, abs_grad_x, abs_grad_y;
-    // cv::GaussianBlur(src, blur, cv::Size(blur_size, blur_size), 0, 0);
-    cv::Laplacian(gray, contours, CV_32F);
+    // NB: buffers are allocated on first frame only
+    gray.create(height, width);
+
+    FrontEndBuffers bufs;
+    if (!gray_ready) {
+        bufs.bgr = color.ptr<uint8_t>();
+        bufs.bgr_step = color.step;
+    }
+    bufs.gray = gray.ptr<uint8_t>();
+    bufs.gray_step = gray.step;
+
+    // contours needed for clipping only
+    if (settings.clip_thresh > 0) {
+        contours.create(height, width);
+        bufs.laplacian = contours.ptr<float>();
+        bufs.laplacian_step = contours.step;
+    }
+
+    // gradients on whole frame only if strokes are too dense for sparse evaluation
+    // (strokes of first frame are not generated yet, assume they will be dense)
+    double density = (double) strokes.size() / ((double) width * height);
+    dense_gradients = settings.gradient_orientation && (first_frame || density >= settings.sparse_gradients_max_density);
+    if (dense_gradients) {
+        grad_x.create(height, width);
+        grad_y.create(height, width);
+        bufs.grad_x = grad_x.ptr<float>();
+        bufs.grad_y = grad_y.ptr<float>();
+        bufs.grad_step = grad_x.step;
+    }
+
+    run_front_end(bufs, width, height);
 }
 
 void Litpression::gen_initial_strokes()
 {
     assert(strokes.empty());
 
-    auto centers = triangulate_add();
-
-    std::shuffle(centers.begin(), centers.end(), rng);
-
-    for (const auto& c : centers) {
-        auto s = gen_stroke(c);
-        strokes.push_back(s);
-    }
+    // initial strokes fill the empty canvas just as new strokes fill holes
+    gen_new_strokes();
 
     // for (int cx = 0; cx < width; cx += STROKE_SPACING) {
     //     for (int cy = 0; cy < width; cy += STROKE_SPACING) {
@@ -83,31 +478,39 @@ void Litpression::gen_initial_strokes()
     // }
 }
 
-vector<cv::Point2f> Litpression::triangulate_add()
+void Litpression::triangulate()
 {
-    vector<double> points_xys;
-    points_xys.reserve(strokes.size() * 2);
-    for (const auto& s : strokes) {
-        points_xys.push_back(s.center.x);
-        points_xys.push_back(s.center.y);
+    auto& points_xys = triangulation_points;
+    points_xys.clear();
+    points_xys.reserve((strokes.size() + corners.size()) * 2);
+    for (size_t i = 0; i < strokes.size(); i++) {
+        points_xys.push_back(strokes.xs[i]);
+        points_xys.push_back(strokes.ys[i]);
     }
 
     // always add corners to be sure that triangles extend to edge of img
+    // (indexed after strokes)
     for (const auto& c : corners) {
         points_xys.push_back(c.x);
         points_xys.push_back(c.y);
     }
 
-    auto points_xys_new = triangle::add_points(points_xys, (double) settings.max_triangle_area);
+    // NB: on failure triangulation is empty, so that this frame neither deletes nor adds strokes
+    triangle_context.triangulate(points_xys, (double) settings.max_triangle_area, triangulation);
+}
+
+void Litpression::compute_triangulation_new_centers()
+{
+    const auto& points_xys_new = triangulation.points_new;
 
-    // Triangle will append coordinates of new points at the end
-    vector<cv::Point2f> centers_new;
-    centers_new.reserve(points_xys_new.size() - points_xys.size());
+    auto& centers_new = triangulation_centers;
+    centers_new.clear();
+    centers_new.reserve(points_xys_new.size() / 2);
 
     float area_sqrt = std::sqrt((float) settings.max_triangle_area);
     std::uniform_real_distribution<float> distr(-area_sqrt, area_sqrt);
 
-    for (size_t i = points_xys.size(); i < points_xys_new.size(); i += 2) {
+    for (size_t i = 0; i < points_xys_new.size(); i += 2) {
         // add random perturbation to avoid patterns/lines created by triangulation
         float cx = points_xys_new[i]; // + distr(rng);
         float cy = points_xys_new[i + 1]; // + distr(rng);
@@ -119,11 +522,10 @@ vector<cv::Point2f> Litpression::triangulate_add()
         cv::Point2f c = cv::Point2f(cx, cy);
         centers_new.push_back(c);
     }
-
-    return centers_new;
 }
 
-Stroke Litpression::gen_stroke(const cv::Point2f& center)
+// append to strokes_new
+void Litpression::gen_stroke(const cv::Point2f& center, int vertex)
 {
     std::uniform_int_distribution<int> length_distr(settings.min_length, settings.max_length);
     std::uniform_int_distribution<int> radius_distr(settings.min_radius, settings.max_radius);
@@ -134,149 +536,319 @@ Stroke Litpression::gen_stroke(const cv::Point2f& center)
     int radius = radius_distr(rng);
     int theta_delta = theta_delta_distr(rng);
 
-    int r_delta = rgb_delta_distr(rng);
-    int g_delta = rgb_delta_distr(rng);
-    int b_delta = rgb_delta_distr(rng);
-
-    auto stroke = Stroke(center, length, radius, settings.theta, theta_delta, r_delta, g_delta, b_delta);
-
-    stroke.center_int = { (int) std::round(center.x), (int) std::round(center.y) };
-    return stroke;
+    // packed on 8 bits
+    int r_delta = std::max(-128, std::min(127, rgb_delta_distr(rng)));
+    int g_delta = std::max(-128, std::min(127, rgb_delta_distr(rng)));
+    int b_delta = std::max(-128, std::min(127, rgb_delta_distr(rng)));
+
+    auto& s = strokes_new;
+    s.xs.push_back(center.x);
+    s.ys.push_back(center.y);
+    s.xs_int.push_back((int) std::round(center.x));
+    s.ys_int.push_back((int) std::round(center.y));
+    s.thetas.push_back((float) settings.theta);
+    s.theta_deltas.push_back((float) theta_delta);
+    s.lengths.push_back((uint16_t) length);
+    s.radiuses.push_back((uint16_t) radius);
+    s.color_deltas.push_back({ { (int8_t) r_delta, (int8_t) g_delta, (int8_t) b_delta } });
+    s.vertices.push_back(vertex);
+    s.starts.emplace_back();
+    s.ends.emplace_back();
 }
 
 void Litpression::move_strokes()
 {
-    vector<size_t> idxs_strokes_to_del;
+    size_t nb_strokes = strokes.size();
+    strokes_del_marks.reset(nb_strokes);
+
+    float* xs = strokes.xs.data();
+    float* ys = strokes.ys.data();
+    int* xs_int = strokes.xs_int.data();
+    int* ys_int = strokes.ys_int.data();
+
+    // move and round centers, and get strokes with center out of bounds
+    strokes_out_ids.resize(nb_strokes);
+    size_t nb_out;
+    if (settings.flow_mode == FlowMode::lk) {
+        // (also lost strokes)
+        nb_out = track_strokes(strokes_out_ids.data());
+    } else {
+        // flow may be at lower resolution than frame
+        FlowField flow_field;
+        flow_field.data = flow.ptr<float>();
+        flow_field.step = flow.step1();
+        flow_field.width = flow.cols;
+        flow_field.height = flow.rows;
+        flow_field.scale_x = (float) width / flow.cols;
+        flow_field.scale_y = (float) height / flow.rows;
+        if (settings.bilinear_flow) {
+            nb_out = advect_bilinear(xs, ys, xs_int, ys_int, nb_strokes, flow_field, width, height, strokes_out_ids.data());
+        } else {
+            nb_out = advect_nearest(xs, ys, xs_int, ys_int, nb_strokes, flow_field, width, height, strokes_out_ids.data());
+        }
+    }
 
-    for (size_t i = 0; i < strokes.size(); i++) {
-        // NB: mutable reference!
-        auto& s = strokes[i];
-
-        auto dxy = flow(s.center.y, s.center.x);
-        s.center.x += dxy[0];
-        s.center.y += dxy[1];
-        s.center_int.x = (int) std::round(s.center.x);
-        s.center_int.y = (int) std::round(s.center.y);
-
-        // delete stroke if center out of bounds
-        if (s.center_int.x < 0 || s.center_int.x > width - 1 || s.center_int.y < 0 || s.center_int.y > height - 1) {
-            idxs_strokes_to_del.push_back(i);
+    // delete them
+    for (size_t k = 0; k < nb_out; k++) {
+        strokes_del_marks.mark(strokes_out_ids[k]);
+    }
+
+    if (settings.density_backend == DensityBackend::mesh) {
+        for (size_t i = 0; i < nb_strokes; i++) {
+            int& vertex = strokes.vertices[i];
+            if (!strokes_del_marks.is_marked(i) && vertex >= 0 && !mesh.move(vertex, xs[i], ys[i])) {
+                // vertex has been dropped by mesh (ex: merged with another one)
+                vertex = -1;
+                strokes_del_marks.mark(i);
+            }
         }
     }
 
-    del_strokes(idxs_strokes_to_del);
+    del_marked_strokes();
 }
 
-void Litpression::del_strokes(vector<size_t>& idxs_strokes_to_del)
+// move strokes centers with Lucas-Kanade tracking between previous and current pyramids,
+// return number of ids of lost or out of bounds strokes written to out_ids (in increasing order)
+size_t Litpression::track_strokes(uint32_t* out_ids)
 {
-    if (idxs_strokes_to_del.empty()) {
-        return;
+    size_t nb_strokes = strokes.size();
+    lk_points.resize(nb_strokes);
+    for (size_t i = 0; i < nb_strokes; i++) {
+        lk_points[i] = cv::Point2f(strokes.xs[i], strokes.ys[i]);
+    }
+    if (nb_strokes == 0) {
+        return 0;
     }
 
-    vector<Stroke> strokes_new;
-    for (size_t i = 0; i < strokes.size(); i++) {
-        auto it = std::find(idxs_strokes_to_del.begin(), idxs_strokes_to_del.end(), i);
-        if (it == idxs_strokes_to_del.end()) {
-            strokes_new.push_back(strokes[i]);
-        } else {
-            idxs_strokes_to_del.erase(it);
+    cv::TermCriteria criteria(cv::TermCriteria::COUNT + cv::TermCriteria::EPS, 30, 0.01);
+    cv::calcOpticalFlowPyrLK(pyramid_prev, pyramid, lk_points, lk_points_next, lk_status, lk_errors,
+        cv::Size(settings.lk_win_size, settings.lk_win_size), settings.lk_max_level, criteria);
+
+    float max_error = (float) settings.lk_max_error;
+    size_t nb_out = 0;
+    for (size_t i = 0; i < nb_strokes; i++) {
+        float x = lk_points_next[i].x;
+        float y = lk_points_next[i].y;
+        strokes.xs[i] = x;
+        strokes.ys[i] = y;
+        strokes.xs_int[i] = (int) std::round(x);
+        strokes.ys_int[i] = (int) std::round(y);
+
+        bool lost = lk_status[i] == 0 || (max_error > 0 && lk_errors[i] > max_error);
+        bool out_of_bounds = strokes.xs_int[i] < 0 || strokes.xs_int[i] > width - 1
+            || strokes.ys_int[i] < 0 || strokes.ys_int[i] > height - 1;
+        if (lost || out_of_bounds) {
+            out_ids[nb_out++] = (uint32_t) i;
         }
     }
-
-    assert(idxs_strokes_to_del.empty());
-    strokes = strokes_new;
+    return nb_out;
 }
 
-void Litpression::del_strokes_too_close()
+void Litpression::del_marked_strokes()
 {
-    vector<double> centers_xys;
-    centers_xys.reserve(strokes.size() * 2);
-    for (const auto& s : strokes) {
-        centers_xys.push_back(s.center.x);
-        centers_xys.push_back(s.center.y);
+    if (strokes_del_marks.count() == 0) {
+        return;
     }
 
-    vector<int> edges_idxs = triangle::list_edges(centers_xys);
-
-    vector<size_t> idxs_strokes_to_del;
-    for (size_t i = 0; i < edges_idxs.size(); i += 2) {
-        size_t i1 = (size_t) edges_idxs[i];
-        size_t i2 = (size_t) edges_idxs[i + 1];
-
-        bool edge_already_del = false;
-        for (auto i : idxs_strokes_to_del) {
-            if (i == i1 || i == i2) {
-                edge_already_del = true;
-                break;
+    if (settings.density_backend == DensityBackend::mesh) {
+        for (size_t i = 0; i < strokes.size(); i++) {
+            if (strokes_del_marks.is_marked(i) && strokes.vertices[i] >= 0) {
+                mesh.remove(strokes.vertices[i]);
             }
         }
+    }
 
-        if (edge_already_del) {
-            continue;
-        }
+    strokes.compact(strokes_del_marks);
+    strokes_del_marks.reset(strokes.size());
+}
 
-        float cx1 = centers_xys[i1 * 2];
-        float cy1 = centers_xys[i1 * 2 + 1];
-        float cx2 = centers_xys[i2 * 2];
-        float cy2 = centers_xys[i2 * 2 + 1];
-        float dist_sq = (cx1 - cx2) * (cx1 - cx2) + (cy1 - cy2) * (cy1 - cy2);
+void Litpression::del_strokes_too_close()
+{
+    size_t nb_strokes = strokes.size();
+    strokes_del_marks.reset(nb_strokes);
+
+    if (settings.density_backend == DensityBackend::mesh) {
+        vertex_strokes.assign(mesh.max_vertex_id(), -1);
+        for (size_t i = 0; i < nb_strokes; i++) {
+            if (strokes.vertices[i] >= 0) {
+                vertex_strokes[strokes.vertices[i]] = (int) i;
+            }
+        }
 
-        if (dist_sq < settings.min_dist_sq) {
-            // remove deepest-layered stroke
-            if (i1 < i2) {
-                idxs_strokes_to_del.push_back(i1);
-            } else {
-                idxs_strokes_to_del.push_back(i2);
+        // mesh bounds have no stroke
+        mesh.for_each_edge([&](int v1, int v2) {
+            int i1 = vertex_strokes[v1];
+            int i2 = vertex_strokes[v2];
+            if (i1 >= 0 && i2 >= 0) {
+                mark_strokes_too_close((size_t) i1, (size_t) i2);
             }
+        });
+
+        if (settings.min_triangle_area > 0) {
+            mesh.for_each_triangle([&](int v1, int v2, int v3) {
+                int i1 = vertex_strokes[v1];
+                int i2 = vertex_strokes[v2];
+                int i3 = vertex_strokes[v3];
+                if (i1 >= 0 && i2 >= 0 && i3 >= 0) {
+                    mark_strokes_too_small((size_t) i1, (size_t) i2, (size_t) i3);
+                }
+            });
         }
+    } else {
+        // grid and triangle backends: triangle backend has no mesh yet, strokes are pruned before refinement
+        // (close strokes are at most in neighbor cells)
+        bucket_strokes(std::sqrt((float) settings.min_dist_sq));
+        grid.for_each_close_pair((float) settings.min_dist_sq, [&](size_t i1, size_t i2) {
+            mark_strokes_too_close(i1, i2);
+        });
     }
 
     // NB: edges closer than STROKE_MIN_DIST may remain
     // hopefully they will be deleted at next round
 
-    del_strokes(idxs_strokes_to_del);
+    del_marked_strokes();
+}
+
+// triangle backend: strokes of triangles of refined mesh smaller than min_triangle_area
+// NB: needs triangle list, so strokes are deleted after refinement (Steiner points are only added in large triangles)
+void Litpression::del_strokes_in_small_triangles()
+{
+    if (settings.min_triangle_area <= 0) {
+        return;
+    }
+    size_t nb_strokes = strokes.size();
+    strokes_del_marks.reset(nb_strokes);
+
+    // triangulation indices past strokes are corners and new points
+    const auto& triangles_idxs = triangulation.triangles;
+    for (size_t i = 0; i < triangles_idxs.size(); i += 3) {
+        size_t i1 = (size_t) triangles_idxs[i];
+        size_t i2 = (size_t) triangles_idxs[i + 1];
+        size_t i3 = (size_t) triangles_idxs[i + 2];
+        if (i1 < nb_strokes && i2 < nb_strokes && i3 < nb_strokes) {
+            mark_strokes_too_small(i1, i2, i3);
+        }
+    }
+
+    del_marked_strokes();
+}
+
+void Litpression::mark_strokes_too_close(size_t i1, size_t i2)
+{
+    bool edge_already_del = strokes_del_marks.is_marked(i1) || strokes_del_marks.is_marked(i2);
+    if (edge_already_del) {
+        return;
+    }
+
+    float dx = strokes.xs[i1] - strokes.xs[i2];
+    float dy = strokes.ys[i1] - strokes.ys[i2];
+    float dist_sq = dx * dx + dy * dy;
+
+    if (dist_sq < settings.min_dist_sq) {
+        // remove deepest-layered stroke
+        strokes_del_marks.mark(std::min(i1, i2));
+    }
+}
+
+void Litpression::mark_strokes_too_small(size_t i1, size_t i2, size_t i3)
+{
+    bool triangle_already_del = strokes_del_marks.is_marked(i1) || strokes_del_marks.is_marked(i2) || strokes_del_marks.is_marked(i3);
+    if (triangle_already_del) {
+        return;
+    }
+
+    const auto& xs = strokes.xs;
+    const auto& ys = strokes.ys;
+    float area = std::abs((xs[i2] - xs[i1]) * (ys[i3] - ys[i1]) - (xs[i3] - xs[i1]) * (ys[i2] - ys[i1])) / 2.0f;
+
+    if (area < settings.min_triangle_area) {
+        // remove deepest-layered stroke
+        strokes_del_marks.mark(std::min(i1, std::min(i2, i3)));
+    }
+}
+
+void Litpression::bucket_strokes(float cell_size)
+{
+    grid.build(strokes.xs.data(), strokes.ys.data(), strokes.size(), std::max(1.0f, cell_size), width, height);
 }
 
 void Litpression::gen_new_strokes()
 {
-    auto new_stroke_centers = triangulate_add();
-    std::shuffle(new_stroke_centers.begin(), new_stroke_centers.end(), rng);
+    strokes_new.clear();
+
+    if (settings.density_backend == DensityBackend::mesh) {
+        vertices_new.clear();
+        mesh.refine(settings.max_triangle_area, 0.0, 0.0, width - 1.0, height - 1.0, vertices_new);
+        std::shuffle(vertices_new.begin(), vertices_new.end(), rng);
+
+        strokes_new.reserve(vertices_new.size());
+        for (int v : vertices_new) {
+            gen_stroke(cv::Point2f((float) mesh.x(v), (float) mesh.y(v)), v);
+        }
+    } else if (settings.density_backend == DensityBackend::grid) {
+        // fill circles as large as those of equilateral triangles of max area,
+        // but do not create strokes that would be deleted as too close
+        float side = std::sqrt(4.0f * settings.max_triangle_area / std::sqrt(3.0f));
+        float radius = std::max(side / std::sqrt(3.0f), std::sqrt((float) settings.min_dist_sq));
+
+        bucket_strokes(radius);
+        centers_xs_new.clear();
+        centers_ys_new.clear();
+        // NB: new centers come out in random order
+        grid.fill_holes(radius, rng, centers_xs_new, centers_ys_new);
+
+        strokes_new.reserve(centers_xs_new.size());
+        for (size_t i = 0; i < centers_xs_new.size(); i++) {
+            gen_stroke(cv::Point2f(centers_xs_new[i], centers_ys_new[i]));
+        }
+    } else {
+        compute_triangulation_new_centers();
+        auto& new_stroke_centers = triangulation_centers;
+        std::shuffle(new_stroke_centers.begin(), new_stroke_centers.end(), rng);
 
-    vector<Stroke> new_strokes;
-    new_strokes.reserve(new_stroke_centers.size());
-    for (const auto& c : new_stroke_centers) {
-        auto s = gen_stroke(c);
-        new_strokes.push_back(s);
+        strokes_new.reserve(new_stroke_centers.size());
+        for (const auto& c : new_stroke_centers) {
+            gen_stroke(c);
+        }
     }
 
     // TODO insert new strokes at random positions among existing strokes
     // for now we insert them at start so they are rendered first
     // thus at a deeper layer, so we have less noise
-    strokes.insert(strokes.begin(), new_strokes.begin(), new_strokes.end());
+    strokes.prepend(strokes_new);
 }
 
 void Litpression::clip_strokes()
 {
-    for (auto& s : strokes) {
-        float theta = s.theta + s.theta_delta;
+    size_t nb_strokes = strokes.size();
+    const float* xs = strokes.xs.data();
+    const float* ys = strokes.ys.data();
+    const float* thetas = strokes.thetas.data();
+    const float* theta_deltas = strokes.theta_deltas.data();
+    const uint16_t* lengths = strokes.lengths.data();
+    cv::Point2i* starts = strokes.starts.data();
+    cv::Point2i* ends = strokes.ends.data();
+
+    for (size_t i = 0; i < nb_strokes; i++) {
+        float theta = thetas[i] + theta_deltas[i];
         float theta_cos = std::cos(theta);
         float theta_sin = std::sin(theta);
-        float length_half = (float) s.length / 2.0f;
-        float start_x = s.center.x - length_half * theta_cos;
-        float start_y = s.center.y - length_half * theta_sin;
-        float end_x = s.center.x + length_half * theta_cos;
-        float end_y = s.center.y + length_half * theta_sin;
+        float length_half = (float) lengths[i] / 2.0f;
+        float start_x = xs[i] - length_half * theta_cos;
+        float start_y = ys[i] - length_half * theta_sin;
+        float end_x = xs[i] + length_half * theta_cos;
+        float end_y = ys[i] + length_half * theta_sin;
 
         if (settings.clip_thresh > 0) {
             // get clipped ends
-            s.start = clip_stroke_half(s.center.x, s.center.y, start_x, start_y);
-            s.end = clip_stroke_half(s.center.x, s.center.y, end_x, end_y);
+            starts[i] = clip_stroke_half(xs[i], ys[i], start_x, start_y);
+            ends[i] = clip_stroke_half(xs[i], ys[i], end_x, end_y);
         } else {
             // clamp ends to bounds
-            s.start.x = std::max(0, std::min(width - 1, (int) std::round(start_x)));
-            s.start.y = std::max(0, std::min(height - 1, (int) std::round(start_y)));
-            s.end.x = std::max(0, std::min(width - 1, (int) std::round(end_x)));
-            s.end.y = std::max(0, std::min(height - 1, (int) std::round(end_y)));
+            starts[i].x = std::max(0, std::min(width - 1, (int) std::round(start_x)));
+            starts[i].y = std::max(0, std::min(height - 1, (int) std::round(start_y)));
+            ends[i].x = std::max(0, std::min(width - 1, (int) std::round(end_x)));
+            ends[i].y = std::max(0, std::min(height - 1, (int) std::round(end_y)));
         }
     }
 }
@@ -284,52 +856,68 @@ void Litpression::clip_strokes()
 // TODO use interpolation for low magnitudes instead of blur
 void Litpression::orient_strokes_with_gradients()
 {
-    // int blur_size = 7;
-    // cv::Mat blur;
-    // cv::GaussianBlur(gray, blur, cv::Size(blur_size, blur_size), 0, 0);
-    cv::Mat grad_x, grad_y;
-    cv::Scharr(gray, grad_x, CV_32F, 1, 0);
-    cv::Scharr(gray, grad_y, CV_32F, 0, 1);
-    // cv::medianBlur(grad_x, grad_x, 7);
-    // cv::medianBlur(grad_y, grad_y, 7);
-    cv::Mat1f mags, angles;
-    cv::cartToPolar(grad_x, grad_y, mags, angles);
-
-
-    // for (int i = 0; i < height * width; i++) {
-    //     if (grad_x(i) < settings.orientation_mag_thresh) {
-    //         // s.theta = angles(s.center_int.y, s.center_int.x) + 1.570; // pi/2
-    //         grad_x(i) = 0;
-    //     }
-    // }
-
-    for (auto& s : strokes) {
-        if (mags(s.center_int.y, s.center_int.x) > settings.orientation_mag_thresh) {
-            s.theta = angles(s.center_int.y, s.center_int.x) + 1.570; // pi/2
-        }
+    // NB: strokes are oriented by gradient at their rounded centers
+    if (dense_gradients) {
+        orient_with_gradients(grad_x.ptr<float>(), grad_y.ptr<float>(), grad_x.step,
+            strokes.xs_int.data(), strokes.ys_int.data(), strokes.size(),
+            (float) settings.orientation_mag_thresh, 1.570f, strokes.thetas.data()); // pi/2
+    } else {
+        orient_with_sparse_gradients(gray.ptr<uint8_t>(), gray.step, width, height,
+            strokes.xs_int.data(), strokes.ys_int.data(), strokes.size(),
+            (float) settings.orientation_mag_thresh, 1.570f, strokes.thetas.data()); // pi/2
     }
 }
 
 void Litpression::draw_strokes()
 {
-    cv::medianBlur(color, color, 5);
+    // NB: not in place, which would copy color
+    cv::medianBlur(color, color_blurred, 5);
+    acquire_out_buffer();
     if (settings.fill_background) {
-        out = color.clone();
+        color_blurred.copyTo(out);
     } else {
-        out = cv::Mat::zeros(height, width, CV_8UC1);
+        out.setTo(cv::Scalar::all(0));
     }
 
-    for (const auto& s : strokes) {
-        cv::Vec3b color_val = color(s.center_int.y, s.center_int.x);
+    rasterizer.reset(width, height);
+    for (size_t i = 0; i < strokes.size(); i++) {
+        cv::Vec3b color_val = color_blurred(strokes.ys_int[i], strokes.xs_int[i]);
         // if (s.radius < 1) {
         //     continue;
         // }
-        color_val[0] = std::max(0, std::min(255, color_val[0] + s.color_delta[0]));
-        color_val[1] = std::max(0, std::min(255, color_val[1] + s.color_delta[1]));
-        color_val[2] = std::max(0, std::min(255, color_val[2] + s.color_delta[2]));
+        const auto& color_delta = strokes.color_deltas[i];
+        color_val[0] = std::max(0, std::min(255, color_val[0] + color_delta[0]));
+        color_val[1] = std::max(0, std::min(255, color_val[1] + color_delta[1]));
+        color_val[2] = std::max(0, std::min(255, color_val[2] + color_delta[2]));
+
+        // same shape as cv::line with thickness of radius
+        const auto& start = strokes.starts[i];
+        const auto& end = strokes.ends[i];
+        rasterizer.add(start.x, start.y, end.x, end.y, strokes.radiuses[i] / 2.0f, &color_val[0]);
+    }
+
+    // tiles drawn in parallel, each one in painter order
+    rasterizer.bin();
+    cv::parallel_for_(cv::Range(0, rasterizer.nb_tiles()), [&](const cv::Range& range) {
+        rasterizer.render_tiles(range.start, range.end, out.ptr<uint8_t>(), out.step);
+    });
+}
 
-        cv::line(out, s.start, s.end, color_val, s.radius);
+void Litpression::acquire_out_buffer()
+{
+    out.release();
+    for (auto& buffer : out_buffers) {
+        // only referenced by pool
+        if (buffer.u != nullptr && CV_XADD(&buffer.u->refcount, 0) == 1) {
+            out = buffer;
+            return;
+        }
     }
+
+    // all buffers still used by callers
+    out_buffers.emplace_back(height, width);
+    nb_new_out_buffers++;
+    out = out_buffers.back();
 }
 
 cv::Point2f Litpression::clip_stroke_half(int cx, int cy, float x, float y)
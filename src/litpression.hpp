@@ -1,13 +1,51 @@
 #pragma once
 
+#include "alloc_counter.hpp"
+#include "budget.hpp"
+#include "del_marks.hpp"
+#include "flow.hpp"
+#include "grid.hpp"
+#include "mesh.hpp"
+#include "raster.hpp"
+#include "stats.hpp"
+#include "strokes.hpp"
+#include "triangle_wrapper.hpp"
+#include <future>
 #include <memory>
 #include <opencv2/opencv.hpp>
 #include <opencv2/optflow.hpp>
 #include <random>
+#include <string>
 #include <vector>
 
 namespace litpression {
 
+// engine used to delete too close strokes and to fill holes between strokes
+enum class DensityBackend
+{
+    // Triangle triangulation of all stroke centers, rebuilt on each frame
+    triangle,
+    // Delaunay mesh kept across frames and updated incrementally as strokes move
+    mesh,
+    // uniform grid of strokes centers, holes filled with Poisson-disk sampling
+    // (ignores min_triangle_area)
+    grid,
+};
+
+// how strokes are moved from frame to frame
+enum class FlowMode
+{
+    // dense optical flow of whole frame, sampled at stroke centers
+    dense,
+    // sparse pyramidal Lucas-Kanade tracking of stroke centers
+    // (flow_alg unused, flow_downscale ignored)
+    lk,
+};
+
+const char* density_backend_name(DensityBackend backend);
+// return false if name is unknown
+bool density_backend_from_name(const std::string& name, DensityBackend& backend);
+
 struct Settings
 {
     // stroke length range (before clip)
@@ -34,6 +72,24 @@ struct Settings
     // (otherwise it will set randomly)
     bool gradient_orientation = true;
     double orientation_mag_thresh = 50;
+    // evaluate gradients at stroke centers only while there are fewer strokes per pixel than this,
+    // otherwise on whole frame (set to 0 to always evaluate on whole frame)
+    double sparse_gradients_max_density = 0.125;
+    // sample flow bilinearly when moving strokes
+    // (otherwise flow of pixel containing stroke center is used)
+    bool bilinear_flow = true;
+    // compute optical flow on gray frames downscaled by this factor (ex: 2 or 4),
+    // flow vectors are scaled back to frame resolution when moving strokes
+    // (must not be changed after first frame)
+    int flow_downscale = 1;
+    // (must not be changed after first frame)
+    FlowMode flow_mode = FlowMode::dense;
+    // Lucas-Kanade search window size and number of pyramid levels above full resolution
+    int lk_win_size = 21;
+    int lk_max_level = 3;
+    // strokes tracked with a higher error (mean absolute difference of window pixels) are deleted
+    // set to 0 to only delete strokes that could not be tracked at all
+    double lk_max_error = 20;
 
     // maximum area of triangles when adding triangles to fill holes and repopulate strokes
     // (chose in relation with stroke radiuses and maybe stroke lengths)
@@ -41,27 +97,25 @@ struct Settings
     // strokes closer than this distance will be deleted to avoid overdensity
     // (chose in relation with stroke_area)
     int min_dist_sq = 30;
-};
+    // strokes forming triangles smaller than this area will be deleted
+    // set to 0 to disable
+    int min_triangle_area = 0;
+    // (must not be changed after first frame)
+    DensityBackend density_backend = DensityBackend::triangle;
 
-struct Stroke
-{
-    cv::Point2f center;
-    int length;
-    int radius;
-    double theta;
-    double theta_delta;
-    cv::Vec3i color_delta;
-
-    cv::Point2i center_int;
-    cv::Point2i start, end;
-
-    Stroke(const cv::Point2f& center, int length, int radius, double theta, double theta_delta, int r_delta, int g_delta, int b_delta)
-        : center(center),
-          length(length),
-          radius(radius),
-          theta(theta),
-          theta_delta(theta_delta),
-          color_delta(r_delta, g_delta, b_delta) {}
+    // target wall time of process calls (in ms): stroke sizes and density and DIS preset are adapted
+    // to meet it, never finer than their values on first frame (which they then overwrite)
+    // set to 0 to disable (must not be changed after first frame)
+    double target_frame_ms = 0;
+
+    // seed of random stroke parameters, applied on first frame
+    // (same frames and settings give same rendering)
+    uint32_t seed = std::mt19937::default_seed;
+
+    // debug: count heap allocations of each process call on calling thread,
+    // and exit if any frame buffer (cv::Mat) is allocated after warm-up frames (DEBUG builds only).
+    // NB: operator new calls are counted but not checked, OpenCV parallel_for_ and Triangle allocate
+    bool check_frame_buffers = false;
 };
 
 class Litpression
@@ -72,6 +126,24 @@ public:
 
     Litpression(cv::Ptr<cv::DenseOpticalFlow> flow_alg) : flow_alg(flow_alg) {}
     cv::Mat3b process(const cv::Mat3b& color);
+    // same as process, but optical flow with next frame is computed in background while frame is rendered,
+    // so rendering of each frame is returned one call later (empty on first call)
+    // (not to be mixed with process calls)
+    cv::Mat3b process_pipelined(const cv::Mat3b& color);
+    // return rendering of last frame passed to process_pipelined (empty if none)
+    cv::Mat3b flush();
+    // start over with a new stream (frames may have another size), keeping flow algorithm and allocated buffers
+    // (settings adapted by frame time budget are restored to their values on first frame, stats are cleared,
+    // strokes are seeded again)
+    void reset();
+
+    // per-stage wall time of process calls
+    const Stats& get_stats() const { return stats; }
+    size_t nb_strokes() const { return strokes.size(); }
+    // load level chosen to meet target_frame_ms (0 for settings of first frame)
+    int budget_level() const { return budget.level(); }
+    // heap allocations of last process call (if check_frame_buffers is set)
+    const AllocCounts& frame_allocations() const { return frame_allocs; }
 
 private:
     bool first_frame = true;
@@ -79,27 +151,105 @@ private:
     int width = 0;
     std::vector<cv::Point2f> corners;
 
+    // NB: frame buffers are allocated on first frames, then reused or swapped
     cv::Mat3b color;
+    cv::Mat3b color_blurred;
     cv::Mat1b gray;
+    // gray frames at flow resolution, share gray buffer if flow is not downscaled
+    cv::Mat1b gray_flow;
     cv::Mat1b gray_prev;
 
     cv::Mat1f contours;
+    // gradients of gray, computed on whole frame only if dense_gradients is set
+    cv::Mat1f grad_x, grad_y;
+    bool dense_gradients = false;
     cv::Mat2f flow;
+    // pipelined processing: frame to render once flow with next frame is started
+    bool has_pending = false;
+    cv::Mat3b color_pending;
+    cv::Mat1b gray_next;
+    cv::Mat2f flow_next;
+    // gray frames at flow resolution, used by flow task only
+    cv::Mat1b gray_flow_from, gray_flow_to;
+    std::future<void> flow_task;
+    // Lucas-Kanade mode: pyramids of previous and current frames,
+    // and pyramid of next frame built by flow task when pipelined
+    std::vector<cv::Mat> pyramid_prev, pyramid, pyramid_next;
+    bool pyramid_ready = false;
+    std::vector<cv::Point2f> lk_points, lk_points_next;
+    std::vector<uint8_t> lk_status;
+    std::vector<float> lk_errors;
+    // rendering of last frame, one of out_buffers
     cv::Mat3b out;
+    // rendered frames are returned to callers without copy,
+    // buffers are reused once callers do not reference them anymore
+    std::vector<cv::Mat3b> out_buffers;
+    StrokeRasterizer rasterizer;
 
-    std::vector<Stroke> strokes;
+    Strokes strokes;
+    // strokes created on current frame
+    Strokes strokes_new;
+    // strokes moved out of bounds
+    std::vector<uint32_t> strokes_out_ids;
+    // strokes to delete at end of current pass
+    DelMarks strokes_del_marks;
+    // single triangulation of stroke centers per frame,
+    // shared by density pruning and hole filling
+    triangle::Context triangle_context;
+    triangle::Triangulation triangulation;
+    std::vector<double> triangulation_points;
+    std::vector<cv::Point2f> triangulation_centers;
+    // or triangulation kept across frames
+    DelaunayMesh mesh;
+    // index of stroke of each mesh vertex
+    std::vector<int> vertex_strokes;
+    std::vector<int> vertices_new;
+    // or grid bucketing of strokes centers (also finds too close strokes of triangle backend)
+    DensityGrid grid;
+    std::vector<float> centers_xs_new, centers_ys_new;
 
     std::mt19937 rng;
 
-    void compute_contours();
+    // frame time budget: settings and DIS parameters of first frame, scaled by load level
+    BudgetController budget;
+    bool budget_started = false;
+    Settings budget_base;
+    bool has_dis_base = false;
+    DISParams dis_base;
+
+    Stats stats;
+    AllocCounts frame_allocs;
+    AllocCounts alloc_counts_begin;
+    size_t nb_new_out_buffers = 0;
+    // frame count at start of warm-up
+    size_t alloc_warmup_start = 0;
+
+    void process_frame(const cv::Mat3b& color, bool pipelined = false);
+    void begin_alloc_check();
+    void end_alloc_check();
+    void acquire_out_buffer();
+    void wait_flow();
+    void adapt_to_budget();
+    void apply_budget_level(int level);
+    void compute_gray(const cv::Mat3b& color, cv::Mat1b& gray);
+    void compute_front_end(bool gray_ready = false);
+    cv::Size flow_size(const cv::Size& size) const;
+    void downscale_for_flow(const cv::Mat1b& gray, cv::Mat1b& gray_flow) const;
+    void build_pyramid(const cv::Mat1b& gray, std::vector<cv::Mat>& pyramid) const;
     void gen_initial_strokes();
-    std::vector<cv::Point2f> triangulate_add();
-    Stroke gen_stroke(const cv::Point2f& center);
+    void triangulate();
+    void compute_triangulation_new_centers();
+    void gen_stroke(const cv::Point2f& center, int vertex = -1);
     void move_strokes();
+    size_t track_strokes(uint32_t* out_ids);
     void orient_strokes_with_gradients();
-    void del_strokes(std::vector<size_t>& idxs_strokes_to_del);
+    void del_marked_strokes();
     void gen_new_strokes();
     void del_strokes_too_close();
+    void del_strokes_in_small_triangles();
+    void mark_strokes_too_close(size_t i1, size_t i2);
+    void mark_strokes_too_small(size_t i1, size_t i2, size_t i3);
+    void bucket_strokes(float cell_size);
     void clip_strokes();
     void draw_strokes();
     cv::Point2f clip_stroke_half(int cx, int cy, float x, float y);
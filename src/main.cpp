@@ -1,8 +1,25 @@
+#include "bounded_queue.hpp"
+#include "flow.hpp"
+#include "frame_io.hpp"
 #include "litpression.hpp"
+#include "seq_prefetcher.hpp"
+#include "seq_writer.hpp"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <csignal>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <functional>
 #include <getopt.h>
+#include <iomanip>
+#include <memory>
 #include <opencv2/opencv.hpp>
 // #include <opencv2/videoio/videoio_c.h>
+#include <sstream>
 #include <string>
+#include <thread>
 #include <utility>
 #include <vector>
 
@@ -10,181 +27,671 @@ using std::string;
 using std::vector;
 
 std::unique_ptr<litpression::Litpression> lit;
-cv::Ptr<cv::DenseOpticalFlow> flow_alg;
-
-cv::Mat3b in_frame;
-cv::Mat3b out_frame;
 
 string out_path = "";
 cv::VideoWriter writer;
 auto write_four_cc = cv::VideoWriter::fourcc('a', 'v', 'c', '1');
 const int WRITE_FPS = 5;
 
+// frames read from stdin or written to stdout instead of files, without display
+const char PIPE_PATH[] = "-";
+bool pipe_out = false;
+litpression::PipeWriter pipe_writer;
+// size of raw BGR24 frames read from stdin or from files (empty if inputs are not raw)
+cv::Size raw_size;
+
+// frames of png sequence read (seq_stop excluded, -1 for until first missing file),
+// decoded ahead by several threads
+int seq_start = 1;
+int seq_stop = -1;
+int seq_stride = 1;
+int nb_decoders = std::max(1, (int) std::thread::hardware_concurrency() / 2);
+
+// output written as numbered png, jpg or exr files, encoded by several threads
+std::unique_ptr<litpression::SeqWriter> seq_writer;
+int nb_encoders = std::max(1, (int) std::thread::hardware_concurrency() / 2);
+
 const char WINDOW_NAME[] = "litpression";
-int frame_i = 1;
+bool display = true;
+bool print_stats = false;
+bool pipelined = false;
+
+// frames passed from reader thread to processor thread,
+// and from processor thread to writer (main) thread
+typedef litpression::BoundedQueue<cv::Mat3b> FrameQueue;
+size_t queue_capacity = 4;
+std::unique_ptr<FrameQueue> in_frames;
+std::unique_ptr<FrameQueue> out_frames;
+
+// read next frame, return false at end of input
+typedef std::function<bool(cv::Mat3b&)> FrameReader;
 
 cv::Ptr<cv::DenseOpticalFlow> init_flow_alg(const string& flow_name) {
-    if (flow_name == "dis") {
-        return cv::DISOpticalFlow::create(cv::DISOpticalFlow::PRESET_MEDIUM);
-    } else if (flow_name == "farneback") {
-        // custom presets to try to make Farneback faster
-        return cv::FarnebackOpticalFlow::create(5, 0.5, true, 13, 7, 7, 1.5);
-    } else if (flow_name == "deep") {
-        return cv::optflow::createOptFlow_DeepFlow();
-    } else if (flow_name == "dualtvl1") {
-        return cv::optflow::createOptFlow_DualTVL1();
-    } else if (flow_name == "simple") {
-        return cv::optflow::createOptFlow_SimpleFlow();
-    } else {
+    // strokes tracked by litpression itself, no dense flow
+    if (flow_name == litpression::LK_FLOW_ALG_NAME) {
+        return nullptr;
+    }
+    auto flow_alg = litpression::create_flow_alg(flow_name);
+    if (flow_alg == nullptr) {
         std::cerr << "Unknown flow algorithm: \"" << flow_name << "\"\n";
         exit(EXIT_FAILURE);
     }
+    return flow_alg;
+}
+
+bool ends_with(string const& value, string const& ending)
+{
+    if (ending.size() > value.size()) {
+        return false;
+    }
+    return std::equal(ending.rbegin(), ending.rend(), value.rbegin());
 }
 
-void run_webcam()
+FrameReader open_webcam()
 {
     // init webcam reader
-    auto cap = cv::VideoCapture(0);
-    if (!cap.isOpened()) {
-        cap.open(cv::CAP_ANY);
-        if (!cap.isOpened()) {
+    auto cap = std::make_shared<cv::VideoCapture>(0);
+    if (!cap->isOpened()) {
+        cap->open(cv::CAP_ANY);
+        if (!cap->isOpened()) {
             std::cerr << "Failed to open webcam" << std::endl;
             exit(1);
         }
     }
 
+    return [cap](cv::Mat3b& frame) { return cap->read(frame); };
+}
+
+// index of frame at given position of png sequence range, -1 past seq_stop
+int seq_frame_index(int pos)
+{
+    int frame_i = seq_start + pos * seq_stride;
+    return seq_stop < 0 || frame_i < seq_stop ? frame_i : -1;
+}
+
+// read image sequence range, from given position
+FrameReader open_seq(const string& path_format, int first_pos = 0)
+{
+    auto pos = std::make_shared<int>(first_pos);
+
+    return [path_format, pos](cv::Mat3b& frame) {
+        int frame_i = seq_frame_index((*pos)++);
+        if (frame_i < 0) {
+            return false;
+        }
+        char path[1024];
+        snprintf(path, 1024, path_format.c_str(), frame_i);
+        frame = cv::imread(path);
+        return frame.data != nullptr;
+    };
+}
+
+// read image sequence, frames decoded ahead in parallel
+// NB: a single file is decoded at once by each job of batch or segment, which already fill cores
+FrameReader open_seq_prefetched(const string& path_format)
+{
+    auto prefetcher = std::make_shared<litpression::SeqPrefetcher>(
+        path_format, seq_start, seq_stop, seq_stride, nb_decoders, 2 * (size_t) nb_decoders);
+
+    return [prefetcher](cv::Mat3b& frame) { return prefetcher->read(frame); };
+}
+
+// read video from given frame, return empty reader if it cannot be opened
+FrameReader try_open_video(const string& in_path, int first_frame = 0)
+{
+    // init video file reader
+    auto cap = std::make_shared<cv::VideoCapture>(in_path);
+    if (!cap->isOpened()) {
+        return nullptr;
+    }
+    if (first_frame > 0) {
+        cap->set(cv::CAP_PROP_POS_FRAMES, first_frame);
+    }
+
+    return [cap](cv::Mat3b& frame) { return cap->isOpened() && cap->read(frame); };
+}
+
+// uncompressed video files are mapped in memory instead of decoded
+bool is_mapped_input(const string& in_path)
+{
+    return ends_with(in_path, ".y4m") || (raw_size.area() > 0 && in_path != PIPE_PATH);
+}
+
+// format of uncompressed inputs (stdin or mapped files): raw if a raw frame size is given, y4m otherwise
+litpression::PipeFormat input_format()
+{
+    return raw_size.area() > 0 ? litpression::PipeFormat::raw_bgr24 : litpression::PipeFormat::y4m;
+}
+
+// read mapped y4m or raw video from given frame, return empty reader if it cannot be opened
+// NB: raw frames reference mapped file, which is kept open as long as reader (and its copies) exist
+FrameReader try_open_mapped(const string& in_path, int first_frame = 0)
+{
+    auto file = std::make_shared<litpression::MappedFrameFile>();
+    if (!file->open(in_path, input_format(), raw_size)) {
+        return nullptr;
+    }
+    auto frame_i = std::make_shared<size_t>((size_t) first_frame);
+
+    return [file, frame_i](cv::Mat3b& frame) { return file->read((*frame_i)++, frame); };
+}
+
+// read png sequence (range), mapped file or video from given frame, return empty reader if it cannot be opened
+FrameReader try_open_file(const string& in_path, int first_frame = 0)
+{
+    if (ends_with(in_path, ".png")) {
+        return open_seq(in_path, first_frame);
+    }
+    if (is_mapped_input(in_path)) {
+        return try_open_mapped(in_path, first_frame);
+    }
+    return try_open_video(in_path, first_frame);
+}
+
+FrameReader open_file(const string& in_path)
+{
+    FrameReader read_frame = try_open_file(in_path);
+    if (!read_frame) {
+        std::cerr << "Failed to open video at path: " << in_path << std::endl;
+        exit(1);
+    }
+    return read_frame;
+}
+
+// reader thread: decode frames ahead of processing
+void read_frames(FrameReader read_frame)
+{
     while (true) {
-        // read frame
-        if (!cap.read(in_frame)) {
+        // NB: new buffer for each frame, readers would overwrite queued frames otherwise
+        cv::Mat3b frame;
+        if (!read_frame(frame)) {
             break;
         }
+        if (!in_frames->push(frame)) {
+            // closed by consumer
+            break;
+        }
+    }
+    in_frames->close();
+}
 
-        // init video writer to optional output file on first iteration
-        // (once we know frame size)
-        if (!out_path.empty() && !writer.isOpened()) {
-            writer = cv::VideoWriter(out_path, write_four_cc, WRITE_FPS, in_frame.size());
+// processor thread
+void process_frames()
+{
+    cv::Mat3b in_frame;
+    bool closed = false;
+    while (!closed && in_frames->pop(in_frame)) {
+        // NB: process never returns a buffer still referenced by queued frames
+        cv::Mat3b out_frame = pipelined ? lit->process_pipelined(in_frame) : lit->process(in_frame);
+        // (no output yet on first pipelined call)
+        if (!out_frame.empty()) {
+            closed = !out_frames->push(out_frame);
+        }
+    }
+    if (pipelined && !closed) {
+        // (nothing to flush if no frame was read)
+        cv::Mat3b flushed = lit->flush();
+        if (!flushed.empty()) {
+            out_frames->push(flushed);
         }
+    }
+    out_frames->close();
+}
 
-        // apply process
-        out_frame = lit->process(in_frame);
+// writer thread, must be main thread as it also displays frames
+void write_frames()
+{
+    cv::Mat3b out_frame;
+    while (out_frames->pop(out_frame)) {
+        if (pipe_out) {
+            if (!pipe_writer.write(out_frame)) {
+                // stop reader and processor threads (ex: downstream process exited)
+                in_frames->close();
+                out_frames->close();
+                break;
+            }
+        } else if (seq_writer) {
+            // NB: frame is queued without copy, its buffer is reused once written
+            seq_writer->write(out_frame);
+        } else {
+            // init video writer to optional output file on first iteration
+            // (once we know frame size)
+            if (!out_path.empty() && !writer.isOpened()) {
+                writer = cv::VideoWriter(out_path, write_four_cc, WRITE_FPS, out_frame.size());
+            }
 
-        // write processed frame to optional output file
-        if (writer.isOpened()) {
-            writer.write(out_frame);
+            // write processed frame to optional output file
+            if (writer.isOpened()) {
+                writer.write(out_frame);
+            }
         }
 
+        if (!display) {
+            continue;
+        }
         // show processed frame
         cv::imshow(WINDOW_NAME, out_frame);
 
         char key = cv::waitKey(1) & 0xFF;
         if (key == 'q') {
+            // stop reader and processor threads
+            in_frames->close();
+            out_frames->close();
             break;
         }
     }
 }
 
-// run algorithm on image sequence
-void run_seq(const string& path_format)
+void run(FrameReader read_frame)
 {
-    while (true) {
-        // read frame
-        char path[1024];
-        snprintf(path, 1024, path_format.c_str(), frame_i);
-        in_frame = cv::imread(path);
-        if (in_frame.data == nullptr) {
-            break;
+    in_frames = std::make_unique<FrameQueue>(queue_capacity);
+    out_frames = std::make_unique<FrameQueue>(queue_capacity);
+
+    std::thread reader(read_frames, read_frame);
+    std::thread processor(process_frames);
+    write_frames();
+    reader.join();
+    processor.join();
+}
+
+// batch mode: jobs rendered by a pool of worker threads, without display
+struct BatchJob
+{
+    string in_path;
+    string out_path;
+    // filled by worker
+    string error;
+    size_t nb_frames = 0;
+    double seconds = 0.0;
+};
+
+typedef std::function<std::unique_ptr<litpression::Litpression>()> LitFactory;
+
+// one job per line: <input> <output.mp4>
+// (input is a video or a png sequence format, empty lines and lines starting with # are skipped)
+vector<BatchJob> read_batch_jobs(const string& list_path)
+{
+    std::ifstream list(list_path);
+    if (!list) {
+        std::cerr << "Failed to open job list at path: " << list_path << std::endl;
+        exit(EXIT_FAILURE);
+    }
+
+    vector<BatchJob> jobs;
+    string line;
+    for (int line_i = 1; std::getline(list, line); line_i++) {
+        std::istringstream fields(line);
+        BatchJob job;
+        if (!(fields >> job.in_path) || job.in_path[0] == '#') {
+            continue;
+        }
+        if (!(fields >> job.out_path) || !ends_with(job.out_path, ".mp4")) {
+            std::cerr << list_path << ":" << line_i << ": expected <input> <output.mp4>\n";
+            exit(EXIT_FAILURE);
         }
+        jobs.push_back(job);
+    }
+    return jobs;
+}
+
+// render job on calling thread (decode, process and encode in turn, other workers fill other cores)
+void render_job(litpression::Litpression& job_lit, BatchJob& job)
+{
+    auto start = std::chrono::steady_clock::now();
+
+    FrameReader read_frame = try_open_file(job.in_path);
+    if (!read_frame) {
+        job.error = "failed to open input";
+        return;
+    }
 
-        // init video writer to optional output file on first iteration
+    cv::VideoWriter job_writer;
+    auto write_frame = [&](const cv::Mat3b& out_frame) {
         // (once we know frame size)
-        if (!out_path.empty() && !writer.isOpened()) {
-            writer = cv::VideoWriter(out_path, write_four_cc, WRITE_FPS, in_frame.size());
+        if (!job_writer.isOpened()) {
+            job_writer.open(job.out_path, write_four_cc, WRITE_FPS, out_frame.size());
+            if (!job_writer.isOpened()) {
+                job.error = "failed to open output";
+                return false;
+            }
+        }
+        job_writer.write(out_frame);
+        return true;
+    };
+
+    // NB: process copies input frames, frame buffer is reused by reader
+    cv::Mat3b frame;
+    bool ok = true;
+    while (ok && read_frame(frame)) {
+        cv::Mat3b out_frame = pipelined ? job_lit.process_pipelined(frame) : job_lit.process(frame);
+        job.nb_frames++;
+        // (no output yet on first pipelined call)
+        if (!out_frame.empty()) {
+            ok = write_frame(out_frame);
         }
+    }
+    if (ok && pipelined && job.nb_frames > 0) {
+        write_frame(job_lit.flush());
+    }
+    if (job.error.empty() && job.nb_frames == 0) {
+        job.error = "no frames";
+    }
 
-        // apply process
-        out_frame = lit->process(in_frame);
+    std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+    job.seconds = elapsed.count();
+}
 
-        // write processed frame to optional output file
-        if (writer.isOpened()) {
-            writer.write(out_frame);
+void run_batch(vector<BatchJob>& jobs, int nb_workers, const LitFactory& create_lit)
+{
+    // NB: OpenCV thread pool is shared by workers (parallel loops run serially while it is busy with
+    // another worker's loop), so its threads are split between workers
+    cv::setNumThreads(std::max(1, cv::getNumberOfCPUs() / nb_workers));
+
+    std::atomic<size_t> next_job(0);
+    auto work = [&]() {
+        // flow algorithm and buffers are reused from job to job
+        auto worker_lit = create_lit();
+        size_t i;
+        while ((i = next_job++) < jobs.size()) {
+            worker_lit->reset();
+            render_job(*worker_lit, jobs[i]);
         }
+    };
 
-        // show processed frame
-        cv::imshow(WINDOW_NAME, out_frame);
+    vector<std::thread> workers;
+    for (int i = 0; i < nb_workers; i++) {
+        workers.emplace_back(work);
+    }
+    for (auto& worker : workers) {
+        worker.join();
+    }
+}
 
-        char key = cv::waitKey(1) & 0xFF;
-        if (key == 'q') {
-            break;
+void print_batch_report(std::ostream& os, const vector<BatchJob>& jobs, int nb_workers, double seconds)
+{
+    auto flags = os.flags();
+    auto precision = os.precision();
+    os << std::fixed << std::setprecision(1);
+
+    os << std::right << std::setw(6) << "job"
+       << std::setw(10) << "frames"
+       << std::setw(10) << "time (s)"
+       << std::setw(10) << "fps"
+       << "  " << std::left << "input" << "\n";
+    size_t nb_frames = 0;
+    size_t nb_failed = 0;
+    for (size_t i = 0; i < jobs.size(); i++) {
+        const BatchJob& job = jobs[i];
+        os << std::right << std::setw(6) << i + 1
+           << std::setw(10) << job.nb_frames
+           << std::setw(10) << job.seconds
+           << std::setw(10) << (job.seconds > 0 ? job.nb_frames / job.seconds : 0.0)
+           << "  " << std::left << job.in_path;
+        if (!job.error.empty()) {
+            os << " (" << job.error << ")";
+            nb_failed++;
         }
-
-        frame_i++;
+        os << "\n";
+        nb_frames += job.nb_frames;
     }
+    os << jobs.size() << " jobs (" << nb_failed << " failed) on " << nb_workers << " workers: "
+       << nb_frames << " frames in " << seconds << " s, " << (seconds > 0 ? nb_frames / seconds : 0.0) << " fps\n";
+
+    os.flags(flags);
+    os.precision(precision);
 }
 
-// run algorithm on video
-void run_video(const string& in_path)
+// offline mode: input split into segments rendered concurrently, each one by its own instance
+// warmed up on frames before its start, then rendered segments are stitched into output
+struct Segment
 {
-    // init video file reader
-    cv::VideoCapture cap = cv::VideoCapture(in_path);
+    // first frame written and past last frame
+    int first = 0;
+    int end = 0;
+    // intermediate rendering, removed once stitched
+    string part_path;
+    // filled by segment thread
+    string error;
+    int nb_written = 0;
+    double seconds = 0.0;
+};
+
+// lossless, so that frames are only degraded once, when stitched parts are encoded into output
+auto part_four_cc = cv::VideoWriter::fourcc('F', 'F', 'V', '1');
+
+// number of frames of video or png sequence range, 0 if unknown
+int count_frames(const string& in_path)
+{
+    if (ends_with(in_path, ".png")) {
+        int nb_frames = 0;
+        char path[1024];
+        while (true) {
+            int frame_i = seq_frame_index(nb_frames);
+            if (frame_i < 0) {
+                return nb_frames;
+            }
+            snprintf(path, 1024, in_path.c_str(), frame_i);
+            if (!std::ifstream(path)) {
+                return nb_frames;
+            }
+            nb_frames++;
+        }
+    }
+    if (is_mapped_input(in_path)) {
+        litpression::MappedFrameFile file;
+        return file.open(in_path, input_format(), raw_size) ? (int) file.nb_frames() : 0;
+    }
+    cv::VideoCapture cap(in_path);
     if (!cap.isOpened()) {
-        std::cerr << "Failed to open video at path: " << in_path << std::endl;
-        exit(1);
+        return 0;
     }
+    // NB: from container metadata, frames past it are not rendered
+    return std::max(0, (int) cap.get(cv::CAP_PROP_FRAME_COUNT));
+}
 
-    while (cap.isOpened()) {
-        // read color frame
-        if (!cap.read(in_frame)) {
-            break;
-        }
+void render_segment(litpression::Litpression& seg_lit, const string& in_path, Segment& seg, int warmup_frames)
+{
+    auto start = std::chrono::steady_clock::now();
+
+    // frames before segment start only bring strokes to a steady state
+    int read_first = std::max(0, seg.first - warmup_frames);
+    FrameReader read_frame = try_open_file(in_path, read_first);
+    if (!read_frame) {
+        seg.error = "failed to open input";
+        return;
+    }
 
-        // init video writer to optional output file on first iteration
-        // (once we know frame size)
-        if (!out_path.empty() && !writer.isOpened()) {
-            writer = cv::VideoWriter(out_path, write_four_cc, WRITE_FPS, in_frame.size());
+    cv::VideoWriter part_writer;
+    // index of next rendered frame
+    int out_i = read_first;
+    auto write_frame = [&](const cv::Mat3b& out_frame) {
+        if (out_i++ < seg.first) {
+            return true;
+        }
+        if (!part_writer.isOpened()) {
+            part_writer.open(seg.part_path, part_four_cc, WRITE_FPS, out_frame.size());
+            if (!part_writer.isOpened()) {
+                seg.error = "failed to open " + seg.part_path;
+                return false;
+            }
+        }
+        part_writer.write(out_frame);
+        seg.nb_written++;
+        return true;
+    };
+
+    cv::Mat3b frame;
+    bool ok = true;
+    for (int in_i = read_first; ok && in_i < seg.end && read_frame(frame); in_i++) {
+        cv::Mat3b out_frame = pipelined ? seg_lit.process_pipelined(frame) : seg_lit.process(frame);
+        // (no output yet on first pipelined call)
+        if (!out_frame.empty()) {
+            ok = write_frame(out_frame);
+        }
+    }
+    if (ok && pipelined) {
+        cv::Mat3b out_frame = seg_lit.flush();
+        if (!out_frame.empty()) {
+            write_frame(out_frame);
         }
+    }
+    part_writer.release();
 
-        // apply process
-        out_frame = lit->process(in_frame);
+    std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+    seg.seconds = elapsed.count();
+}
 
-        // write processed frame to optional output file
-        if (writer.isOpened()) {
-            writer.write(out_frame);
+// append frames of rendered segment to output writer, errors are set on segment
+// NB: does not exit, later segments are still rendered by other threads
+void stitch_segment(Segment& seg)
+{
+    if (seg.nb_written == 0) {
+        return;
+    }
+    cv::VideoCapture part(seg.part_path);
+    if (!part.isOpened()) {
+        std::cerr << "Failed to read segment at path: " << seg.part_path << std::endl;
+        seg.error = "failed to read " + seg.part_path;
+        return;
+    }
+    cv::Mat3b frame;
+    int nb_stitched = 0;
+    while (part.read(frame)) {
+        // init video writer on first frame (once we know frame size)
+        if (!writer.isOpened()) {
+            writer = cv::VideoWriter(out_path, write_four_cc, WRITE_FPS, frame.size());
+            if (!writer.isOpened()) {
+                std::cerr << "Failed to open output at path: " << out_path << std::endl;
+                seg.error = "failed to open output";
+                return;
+            }
         }
+        writer.write(frame);
+        nb_stitched++;
+    }
+    part.release();
+    if (nb_stitched != seg.nb_written) {
+        std::cerr << "Failed to read all frames of segment at path: " << seg.part_path << std::endl;
+        seg.error = "truncated " + seg.part_path;
+        return;
+    }
+    std::remove(seg.part_path.c_str());
+}
 
-        // show processed frame
-        cv::imshow(WINDOW_NAME, out_frame);
+// return false if a segment failed (output then misses its frames)
+bool run_segments(const string& in_path, int nb_segments, int warmup_frames, const LitFactory& create_lit)
+{
+    int nb_frames = count_frames(in_path);
+    if (nb_frames == 0) {
+        std::cerr << "Failed to count frames of input at path: " << in_path << std::endl;
+        exit(EXIT_FAILURE);
+    }
+    nb_segments = std::max(1, std::min(nb_segments, nb_frames));
+
+    vector<Segment> segments(nb_segments);
+    for (int i = 0; i < nb_segments; i++) {
+        Segment& seg = segments[i];
+        seg.first = (int) ((int64_t) nb_frames * i / nb_segments);
+        seg.end = (int) ((int64_t) nb_frames * (i + 1) / nb_segments);
+        seg.part_path = out_path + ".part" + std::to_string(i) + ".avi";
+    }
 
-        char key = cv::waitKey(1) & 0xFF;
-        if (key == 'q') {
-            break;
+    auto start = std::chrono::steady_clock::now();
+    // NB: OpenCV thread pool is shared by segments (see run_batch)
+    cv::setNumThreads(std::max(1, cv::getNumberOfCPUs() / nb_segments));
+
+    vector<std::thread> threads;
+    for (int i = 0; i < nb_segments; i++) {
+        threads.emplace_back([&, i]() {
+            auto seg_lit = create_lit();
+            // distinct but reproducible strokes of each segment
+            seg_lit->settings.seed += (uint32_t) i;
+            render_segment(*seg_lit, in_path, segments[i], warmup_frames);
+        });
+    }
+    // first segments are stitched while last ones are still rendered
+    for (int i = 0; i < nb_segments; i++) {
+        threads[i].join();
+        stitch_segment(segments[i]);
+    }
+    writer.release();
+    std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+
+    bool all_ok = true;
+    int nb_written = 0;
+    for (int i = 0; i < nb_segments; i++) {
+        const Segment& seg = segments[i];
+        std::cout << "segment " << i + 1 << ": frames " << seg.first << " to " << seg.end - 1 << ", "
+                  << seg.nb_written << " rendered in " << seg.seconds << " s";
+        if (!seg.error.empty()) {
+            std::cout << " (" << seg.error << ")";
+            all_ok = false;
         }
+        std::cout << "\n";
+        nb_written += seg.nb_written;
     }
+    std::cout << nb_segments << " segments (" << warmup_frames << " warm-up frames): " << nb_written << " frames in "
+              << elapsed.count() << " s, " << nb_written / elapsed.count() << " fps\n";
+    return all_ok;
 }
 
-
 void usage(const char* exec_name)
 {
-    std::cerr << "Usage: " << exec_name << " [options] (webcam | <path_to_video>)\n";
+    std::cerr << "Usage: " << exec_name << " [options] (webcam | <path_to_video> | -)\n";
+    std::cerr << "       " << exec_name << " [options] -b <jobs.txt>\n";
+    std::cerr << "       " << exec_name << " [options] -n <nb> -o <path.mp4> <path_to_video>\n";
     std::cerr << "Options:\n";
-    std::cerr << "  -f <name>\t\tSelect flow algorithm (dis, farneback, deep, dualtvl1, simple)\n";
+    std::cerr << "  -f <name>\t\tSelect flow algorithm (" << litpression::FLOW_ALG_NAMES << ")\n";
     std::cerr << "  -o <path.mp4>\t\tWrite rendered output to mp4 file\n";
-}
-
-bool ends_with(string const& value, string const& ending)
-{
-    if (ending.size() > value.size()) {
-        return false;
-    }
-    return std::equal(ending.rbegin(), ending.rend(), value.rbegin());
+    std::cerr << "  -o <path_%05d.png>\tWrite rendered frames as numbered png, jpg or exr (linear float) files, from 1\n";
+    std::cerr << "  --encoders <nb>\tNumber of threads encoding output image files (default: half the cores)\n";
+    std::cerr << "  -o -\t\t\tWrite rendered frames to stdout, in format of stdin frames (raw BGR24 if not read from stdin)\n";
+    std::cerr << "  --raw-size <w>x<h>\tRead raw BGR24 frames of given size from stdin (\"-\" input, instead of Y4M) or from input files\n";
+    std::cerr << "\t\t\t(.y4m and raw input files are mapped in memory instead of decoded)\n";
+    std::cerr << "  --range <start>[:<stop>[:<stride>]]\tFrames of png sequences to read, stop excluded (default: 1, until last file)\n";
+    std::cerr << "  --decoders <nb>\tNumber of threads decoding png sequence frames ahead (default: half the cores)\n";
+    std::cerr << "  -d <name>\t\tSelect density backend (triangle, mesh, grid)\n";
+    std::cerr << "  -p\t\t\tCompute optical flow of next frame while rendering current one (one frame of extra latency)\n";
+    std::cerr << "  -s <factor>\t\tCompute optical flow on frames downscaled by factor (ex: 2 or 4, default: 1)\n";
+    std::cerr << "  -t <ms>\t\tTarget frame time, stroke sizes and flow preset are adapted to meet it (default: 0, disabled)\n";
+    std::cerr << "  -q <nb>\t\tCapacity of frame queues between reader, processor and writer threads (default: 4)\n";
+    std::cerr << "  -b <jobs.txt>\t\tRender jobs listed one per line as \"<input> <output.mp4>\", without display\n";
+    std::cerr << "  -j <nb>\t\tNumber of batch workers rendering jobs concurrently (default: number of cores)\n";
+    std::cerr << "  -n <nb>\t\tRender input offline in nb segments concurrently, stitched into output (no display)\n";
+    std::cerr << "  -k <nb>\t\tFrames rendered before each segment to warm strokes up, not written (default: 30)\n";
+    std::cerr << "  --stats\t\tPrint per-stage processing times and queue depths on exit\n";
+#ifdef DEBUG
+    std::cerr << "  --check-frame-buffers\t(debug) Exit if frame buffers are allocated after warm-up frames\n";
+#endif
 }
 
 
 int main(int argc, char* argv[])
 {
     string flow_name = "dis";
-
-    char opt;
-    while ((opt = getopt(argc, argv, "f:o:")) != -1) {
+    auto density_backend = litpression::DensityBackend::triangle;
+    int flow_downscale = 1;
+    double target_frame_ms = 0;
+    bool check_frame_buffers = false;
+    string batch_path = "";
+    int nb_workers = cv::getNumberOfCPUs();
+    int nb_segments = 0;
+    int warmup_frames = 30;
+
+    const struct option long_opts[] = {
+        { "stats", no_argument, nullptr, 'S' },
+#ifdef DEBUG
+        { "check-frame-buffers", no_argument, nullptr, 'A' },
+#endif
+        { "raw-size", required_argument, nullptr, 'R' },
+        { "range", required_argument, nullptr, 'F' },
+        { "decoders", required_argument, nullptr, 'D' },
+        { "encoders", required_argument, nullptr, 'E' },
+        { nullptr, 0, nullptr, 0 }
+    };
+
+    int opt;
+    while ((opt = getopt_long(argc, argv, "f:o:d:ps:t:q:b:j:n:k:", long_opts, nullptr)) != -1) {
         switch (opt) {
         case 'f':
             flow_name = string(optarg);
@@ -192,39 +699,201 @@ int main(int argc, char* argv[])
 
         case 'o':
             out_path = string(optarg);
-            if (!ends_with(out_path, ".mp4")) {
-                std::cerr << "Output file must be mp4\n";
+            if (out_path != PIPE_PATH && !ends_with(out_path, ".mp4") && !litpression::is_seq_path(out_path)) {
+                std::cerr << "Output file must be mp4, a numbered image sequence (ex: out_%05d.png) or - for stdout\n";
+                exit(EXIT_FAILURE);
+            }
+            break;
+
+        case 'd':
+            if (!litpression::density_backend_from_name(optarg, density_backend)) {
+                std::cerr << "Unknown density backend: \"" << optarg << "\"\n";
+                exit(EXIT_FAILURE);
+            }
+            break;
+
+        case 'p':
+            pipelined = true;
+            break;
+
+        case 's':
+            flow_downscale = std::max(1, std::stoi(optarg));
+            break;
+
+        case 't':
+            target_frame_ms = std::stod(optarg);
+            break;
+
+        case 'q':
+            queue_capacity = (size_t) std::max(1, std::stoi(optarg));
+            break;
+
+        case 'b':
+            batch_path = string(optarg);
+            break;
+
+        case 'j':
+            nb_workers = std::max(1, std::stoi(optarg));
+            break;
+
+        case 'n':
+            nb_segments = std::max(1, std::stoi(optarg));
+            break;
+
+        case 'k':
+            warmup_frames = std::max(0, std::stoi(optarg));
+            break;
+
+        case 'R':
+            if (std::sscanf(optarg, "%dx%d", &raw_size.width, &raw_size.height) != 2
+                || raw_size.width <= 0 || raw_size.height <= 0) {
+                std::cerr << "Invalid raw frame size: \"" << optarg << "\"\n";
                 exit(EXIT_FAILURE);
             }
             break;
 
+        case 'F':
+            // (stop and stride are optional)
+            if (std::sscanf(optarg, "%d:%d:%d", &seq_start, &seq_stop, &seq_stride) < 1 || seq_stride < 1) {
+                std::cerr << "Invalid frame range: \"" << optarg << "\"\n";
+                exit(EXIT_FAILURE);
+            }
+            break;
+
+        case 'D':
+            nb_decoders = std::max(1, std::stoi(optarg));
+            break;
+
+        case 'E':
+            nb_encoders = std::max(1, std::stoi(optarg));
+            break;
+
+        case 'S':
+            print_stats = true;
+            break;
+
+#ifdef DEBUG
+        case 'A':
+            check_frame_buffers = true;
+            break;
+#endif
+
         default:
             usage(argv[0]);
             exit(EXIT_FAILURE);
         }
     }
 
-    if (argc - optind != 1) {
+    bool batch = !batch_path.empty();
+    if (argc - optind != (batch ? 0 : 1)) {
         usage(argv[0]);
         exit(EXIT_FAILURE);
     }
 
-    flow_alg = init_flow_alg(flow_name);
-    lit = std::make_unique<litpression::Litpression>(flow_alg);
+    if (check_frame_buffers) {
+        // before reader and worker threads start using OpenCV
+        litpression::enable_alloc_counter();
+    }
+    // NB: each instance has its own flow algorithm, they are not thread safe
+    LitFactory create_lit = [&]() {
+        auto new_lit = std::make_unique<litpression::Litpression>(init_flow_alg(flow_name));
+        new_lit->settings.density_backend = density_backend;
+        new_lit->settings.flow_downscale = flow_downscale;
+        new_lit->settings.target_frame_ms = target_frame_ms;
+        new_lit->settings.check_frame_buffers = check_frame_buffers;
+        if (flow_name == litpression::LK_FLOW_ALG_NAME) {
+            new_lit->settings.flow_mode = litpression::FlowMode::lk;
+        }
+        return new_lit;
+    };
+
+    if (batch) {
+        vector<BatchJob> jobs = read_batch_jobs(batch_path);
+        nb_workers = std::max(1, std::min(nb_workers, (int) jobs.size()));
+        auto start = std::chrono::steady_clock::now();
+        run_batch(jobs, nb_workers, create_lit);
+        std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+        print_batch_report(std::cout, jobs, nb_workers, elapsed.count());
+
+        bool all_ok = std::all_of(jobs.begin(), jobs.end(), [](const BatchJob& job) { return job.error.empty(); });
+        return all_ok ? 0 : EXIT_FAILURE;
+    }
 
-    string arg = string(argv[optind]);
-    cv::namedWindow(WINDOW_NAME, cv::WINDOW_NORMAL);
+    if (nb_segments > 0) {
+        if (!ends_with(out_path, ".mp4")) {
+            std::cerr << "Segmented rendering needs an mp4 output file (-o)\n";
+            exit(EXIT_FAILURE);
+        }
+        if (target_frame_ms > 0) {
+            // load levels depend on timings, rendering would not be reproducible
+            std::cerr << "Frame time budget is ignored by segmented rendering\n";
+            target_frame_ms = 0;
+        }
+        return run_segments(argv[optind], nb_segments, warmup_frames, create_lit) ? 0 : EXIT_FAILURE;
+    }
+
+    lit = create_lit();
 
-    if (arg == "webcam") {
-        run_webcam();
+    string arg = string(argv[optind]);
+    bool pipe_in = arg == PIPE_PATH;
+    pipe_out = out_path == PIPE_PATH;
+    // NB: headless as soon as a pipe is used, highgui is never initialized
+    display = !pipe_in && !pipe_out;
+
+    FrameReader read_frame;
+    auto pipe_format = litpression::PipeFormat::raw_bgr24;
+    int fps_num = WRITE_FPS;
+    int fps_den = 1;
+    if (pipe_in) {
+        auto pipe_reader = std::make_shared<litpression::PipeReader>();
+        pipe_format = input_format();
+        if (!pipe_reader->open(stdin, pipe_format, raw_size)) {
+            exit(EXIT_FAILURE);
+        }
+        if (pipe_reader->fps_num > 0) {
+            fps_num = pipe_reader->fps_num;
+            fps_den = pipe_reader->fps_den;
+        }
+        read_frame = [pipe_reader](cv::Mat3b& frame) { return pipe_reader->read(frame); };
+    } else if (arg == "webcam") {
+        read_frame = open_webcam();
+    } else if (ends_with(arg, ".png")) {
+        read_frame = open_seq_prefetched(arg);
     } else {
-        string path = argv[optind];
-        if (ends_with(path, ".png")) {
-            run_seq(path);
-        } else {
-            run_video(path);
+        // NB: read_frame keeps mapped input files open until frames queued by reader thread are processed
+        read_frame = open_file(arg);
+    }
+    if (pipe_out) {
+        // writes fail with EPIPE instead of killing process when downstream exits,
+        // so threads are stopped and stats printed as on 'q' key
+        signal(SIGPIPE, SIG_IGN);
+        pipe_writer.open(stdout, pipe_format, fps_num, fps_den);
+    } else if (litpression::is_seq_path(out_path)) {
+        if (ends_with(out_path, ".exr")) {
+            // NB: EXR codec is disabled by default in OpenCV, read on first use
+            setenv("OPENCV_IO_ENABLE_OPENEXR", "1", 0);
+        }
+        // at most two frames per thread wait to be encoded, processing is slowed down otherwise
+        seq_writer = std::make_unique<litpression::SeqWriter>(out_path, nb_encoders, 2 * nb_encoders);
+    }
+
+    if (display) {
+        cv::namedWindow(WINDOW_NAME, cv::WINDOW_NORMAL);
+    }
+    run(read_frame);
+    bool written = !seq_writer || seq_writer->close();
+
+    if (print_stats) {
+        lit->get_stats().print(std::cerr);
+        if (target_frame_ms > 0) {
+            std::cerr << "budget level: " << lit->budget_level() << "\n";
+        }
+        in_frames->get_stats().print(std::cerr, "read queue");
+        out_frames->get_stats().print(std::cerr, "write queue");
+        if (seq_writer) {
+            seq_writer->print_stats(std::cerr);
         }
     }
 
-    return 0;
+    return written ? 0 : EXIT_FAILURE;
 }
@@ -0,0 +1,621 @@
+#include "mesh.hpp"
+#include <algorithm>
+#include <cassert>
+#include <utility>
+
+namespace litpression {
+
+// upper bound of flips per legalization, guards against cycles
+// caused by rounding errors on nearly cocircular points
+static const size_t MAX_FLIPS = 1 << 16;
+// refinement rounds, flips might create new large triangles
+static const int MAX_REFINE_ROUNDS = 16;
+// squared distance under which points are considered coincident
+static const double MIN_DIST_SQ = 1e-12;
+
+void DelaunayMesh::reset(double x0, double y0, double x1, double y1)
+{
+    assert(x0 < x1 && y0 < y1);
+
+    xs.clear();
+    ys.clear();
+    vtris.clear();
+    free_vs.clear();
+    tris.clear();
+    free_tris.clear();
+    // same mesh for same vertices, whatever was inserted before reset
+    rand_state = 1;
+
+    int a = new_vertex(x0, y0);
+    int b = new_vertex(x1, y0);
+    int c = new_vertex(x1, y1);
+    int d = new_vertex(x0, y1);
+    assert(d == nb_bounds - 1);
+
+    // split rectangle along a-c diagonal
+    int t0 = new_tri();
+    int t1 = new_tri();
+    set_tri(t0, a, b, c, -1, t1, -1);
+    set_tri(t1, a, c, d, -1, -1, t0);
+    vtris[a] = t0;
+    vtris[b] = t0;
+    vtris[c] = t0;
+    vtris[d] = t1;
+    last_tri = t0;
+}
+
+int DelaunayMesh::insert(double x, double y)
+{
+    if (!(x > xs[0] && x < xs[2] && y > ys[0] && y < ys[2])) {
+        return -1;
+    }
+
+    int v = new_vertex(x, y);
+    if (!insert_vertex(v)) {
+        free_vertex(v);
+        return -1;
+    }
+    return v;
+}
+
+void DelaunayMesh::remove(int v)
+{
+    assert(!is_bound(v) && vtris[v] >= 0);
+    unlink_vertex(v);
+    free_vertex(v);
+}
+
+bool DelaunayMesh::move(int v, double x, double y)
+{
+    assert(vtris[v] >= 0);
+    if (is_bound(v) || (x == xs[v] && y == ys[v])) {
+        return true;
+    }
+    if (!(x > xs[0] && x < xs[2] && y > ys[0] && y < ys[2])) {
+        remove(v);
+        return false;
+    }
+
+    // vertex can be moved in place if it stays inside the kernel of its star,
+    // ie all its incident triangles keep their orientation
+    bool in_kernel = true;
+    int t0 = vtris[v];
+    int t = t0;
+    do {
+        int k = index_in(t, v);
+        int a = tris[t].v[(k + 1) % 3];
+        int b = tris[t].v[(k + 2) % 3];
+        if (orient(a, b, x, y) <= 0) {
+            in_kernel = false;
+            break;
+        }
+        t = tris[t].n[(k + 1) % 3];
+    } while (t != t0);
+
+    if (!in_kernel) {
+        // fallback to removal and reinsertion (keeping same id)
+        unlink_vertex(v);
+        xs[v] = x;
+        ys[v] = y;
+        if (!insert_vertex(v)) {
+            free_vertex(v);
+            return false;
+        }
+        return true;
+    }
+
+    xs[v] = x;
+    ys[v] = y;
+
+    // edges of star and of its link might not be Delaunay anymore
+    t = t0;
+    do {
+        int k = index_in(t, v);
+        // link edge, and spoke shared with next triangle
+        flip_stack.emplace_back(t, k);
+        flip_stack.emplace_back(t, (k + 1) % 3);
+        t = tris[t].n[(k + 1) % 3];
+    } while (t != t0);
+    legalize();
+
+    return true;
+}
+
+void DelaunayMesh::refine(double max_area, double x0, double y0, double x1, double y1, std::vector<int>& vs_new)
+{
+    for (int round = 0; round < MAX_REFINE_ROUNDS; round++) {
+        big_tris.clear();
+        for (int t = 0; t < (int) tris.size(); t++) {
+            if (tris[t].v[0] >= 0 && area(t) > max_area) {
+                big_tris.push_back(t);
+            }
+        }
+        if (big_tris.empty()) {
+            break;
+        }
+
+        for (int t : big_tris) {
+            // triangle might have been modified by previous insertions
+            if (tris[t].v[0] < 0 || area(t) <= max_area) {
+                continue;
+            }
+
+            const auto& tri = tris[t];
+            double cx = (xs[tri.v[0]] + xs[tri.v[1]] + xs[tri.v[2]]) / 3.0;
+            double cy = (ys[tri.v[0]] + ys[tri.v[1]] + ys[tri.v[2]]) / 3.0;
+            cx = std::max(x0, std::min(x1, cx));
+            cy = std::max(y0, std::min(y1, cy));
+
+            last_tri = t;
+            int v = insert(cx, cy);
+            if (v >= 0) {
+                vs_new.push_back(v);
+            }
+        }
+    }
+}
+
+double DelaunayMesh::orient(int a, int b, int c) const
+{
+    return orient(a, b, xs[c], ys[c]);
+}
+
+// positive if (a, b, (x, y)) is counter-clockwise
+double DelaunayMesh::orient(int a, int b, double x, double y) const
+{
+    return (xs[b] - xs[a]) * (y - ys[a]) - (ys[b] - ys[a]) * (x - xs[a]);
+}
+
+// true if d is strictly inside circumcircle of triangle t
+bool DelaunayMesh::in_circle(int t, int d) const
+{
+    const auto& tri = tris[t];
+    double adx = xs[tri.v[0]] - xs[d];
+    double ady = ys[tri.v[0]] - ys[d];
+    double bdx = xs[tri.v[1]] - xs[d];
+    double bdy = ys[tri.v[1]] - ys[d];
+    double cdx = xs[tri.v[2]] - xs[d];
+    double cdy = ys[tri.v[2]] - ys[d];
+
+    double det = (adx * adx + ady * ady) * (bdx * cdy - cdx * bdy)
+        + (bdx * bdx + bdy * bdy) * (cdx * ady - adx * cdy)
+        + (cdx * cdx + cdy * cdy) * (adx * bdy - bdx * ady);
+    return det > 0;
+}
+
+double DelaunayMesh::area(int t) const
+{
+    const auto& tri = tris[t];
+    return orient(tri.v[0], tri.v[1], tri.v[2]) / 2.0;
+}
+
+int DelaunayMesh::new_tri()
+{
+    if (!free_tris.empty()) {
+        int t = free_tris.back();
+        free_tris.pop_back();
+        return t;
+    }
+    tris.push_back({ { -1, -1, -1 }, { -1, -1, -1 } });
+    return (int) tris.size() - 1;
+}
+
+void DelaunayMesh::free_tri(int t)
+{
+    tris[t].v[0] = -1;
+    free_tris.push_back(t);
+}
+
+int DelaunayMesh::new_vertex(double x, double y)
+{
+    if (!free_vs.empty()) {
+        int v = free_vs.back();
+        free_vs.pop_back();
+        xs[v] = x;
+        ys[v] = y;
+        return v;
+    }
+    xs.push_back(x);
+    ys.push_back(y);
+    vtris.push_back(-1);
+    return (int) xs.size() - 1;
+}
+
+void DelaunayMesh::free_vertex(int v)
+{
+    vtris[v] = -1;
+    free_vs.push_back(v);
+}
+
+void DelaunayMesh::set_tri(int t, int a, int b, int c, int na, int nb, int nc)
+{
+    auto& tri = tris[t];
+    tri.v[0] = a;
+    tri.v[1] = b;
+    tri.v[2] = c;
+    tri.n[0] = na;
+    tri.n[1] = nb;
+    tri.n[2] = nc;
+}
+
+// make neighbor the triangle across edge (a, b) of t
+void DelaunayMesh::relink(int t, int a, int b, int neighbor)
+{
+    if (t < 0) {
+        return;
+    }
+    auto& tri = tris[t];
+    for (int i = 0; i < 3; i++) {
+        if (tri.v[i] != a && tri.v[i] != b) {
+            tri.n[i] = neighbor;
+            return;
+        }
+    }
+    assert(false);
+}
+
+int DelaunayMesh::index_in(int t, int v) const
+{
+    const auto& tri = tris[t];
+    int i = tri.v[0] == v ? 0 : (tri.v[1] == v ? 1 : 2);
+    assert(tri.v[i] == v);
+    return i;
+}
+
+// return triangle containing (x, y), or -1 if outside,
+// nb_zeros is the number of edges (x, y) lies on, zero_i the index of last one
+int DelaunayMesh::locate(double x, double y, int& nb_zeros, int& zero_i)
+{
+    int t = last_tri;
+    if (t < 0 || t >= (int) tris.size() || tris[t].v[0] < 0) {
+        t = vtris[0];
+    }
+
+    // stochastic walk, bounded in case rounding errors make it cycle
+    size_t max_steps = tris.size() + 16;
+    for (size_t step = 0; step < max_steps; step++) {
+        const auto& tri = tris[t];
+        int start = (int) (rand_next() % 3);
+        int next = -2;
+        for (int k = 0; k < 3; k++) {
+            int i = (start + k) % 3;
+            if (orient(tri.v[(i + 1) % 3], tri.v[(i + 2) % 3], x, y) < 0) {
+                next = tri.n[i];
+                break;
+            }
+        }
+
+        if (next == -2) {
+            nb_zeros = 0;
+            for (int i = 0; i < 3; i++) {
+                if (orient(tri.v[(i + 1) % 3], tri.v[(i + 2) % 3], x, y) == 0) {
+                    nb_zeros++;
+                    zero_i = i;
+                }
+            }
+            last_tri = t;
+            return t;
+        }
+        if (next < 0) {
+            return -1;
+        }
+        t = next;
+    }
+
+    // exhaustive search
+    for (t = 0; t < (int) tris.size(); t++) {
+        const auto& tri = tris[t];
+        if (tri.v[0] < 0) {
+            continue;
+        }
+        nb_zeros = 0;
+        bool inside = true;
+        for (int i = 0; i < 3 && inside; i++) {
+            double o = orient(tri.v[(i + 1) % 3], tri.v[(i + 2) % 3], x, y);
+            if (o < 0) {
+                inside = false;
+            } else if (o == 0) {
+                nb_zeros++;
+                zero_i = i;
+            }
+        }
+        if (inside) {
+            last_tri = t;
+            return t;
+        }
+    }
+    return -1;
+}
+
+// link free vertex v into triangulation at its current coordinates
+bool DelaunayMesh::insert_vertex(int v)
+{
+    int nb_zeros = 0;
+    int zero_i = 0;
+    int t = locate(xs[v], ys[v], nb_zeros, zero_i);
+    if (t < 0 || nb_zeros > 1) {
+        return false;
+    }
+
+    for (int i = 0; i < 3; i++) {
+        int w = tris[t].v[i];
+        double dx = xs[w] - xs[v];
+        double dy = ys[w] - ys[v];
+        if (dx * dx + dy * dy < MIN_DIST_SQ) {
+            return false;
+        }
+    }
+
+    if (nb_zeros == 0) {
+        split_tri(t, v);
+    } else {
+        if (tris[t].n[zero_i] < 0) {
+            // on bounds
+            return false;
+        }
+        split_edge(t, zero_i, v);
+    }
+
+    legalize();
+    return true;
+}
+
+void DelaunayMesh::split_tri(int t, int p)
+{
+    int a = tris[t].v[0];
+    int b = tris[t].v[1];
+    int c = tris[t].v[2];
+    int na = tris[t].n[0];
+    int nb = tris[t].n[1];
+    int nc = tris[t].n[2];
+
+    // NB: may reallocate tris
+    int t1 = new_tri();
+    int t2 = new_tri();
+
+    set_tri(t, a, b, p, t1, t2, nc);
+    set_tri(t1, b, c, p, t2, t, na);
+    set_tri(t2, c, a, p, t, t1, nb);
+    relink(na, b, c, t1);
+    relink(nb, c, a, t2);
+
+    vtris[a] = t;
+    vtris[b] = t;
+    vtris[c] = t1;
+    vtris[p] = t;
+
+    flip_stack.emplace_back(t, 2);
+    flip_stack.emplace_back(t1, 2);
+    flip_stack.emplace_back(t2, 2);
+}
+
+// split edge opposite to vertex i of t, and triangle on other side
+void DelaunayMesh::split_edge(int t, int i, int p)
+{
+    int a = tris[t].v[i];
+    int b = tris[t].v[(i + 1) % 3];
+    int c = tris[t].v[(i + 2) % 3];
+    int u = tris[t].n[i];
+    int tb = tris[t].n[(i + 1) % 3];
+    int tc = tris[t].n[(i + 2) % 3];
+
+    // u is (d, c, b)
+    int j = tris[u].n[0] == t ? 0 : (tris[u].n[1] == t ? 1 : 2);
+    assert(tris[u].n[j] == t);
+    int d = tris[u].v[j];
+    int uc = tris[u].n[(j + 1) % 3];
+    int ub = tris[u].n[(j + 2) % 3];
+
+    int t2 = new_tri();
+    int u2 = new_tri();
+
+    set_tri(t, a, b, p, u, t2, tc);
+    set_tri(t2, a, p, c, u2, tb, t);
+    set_tri(u, d, p, b, t, uc, u2);
+    set_tri(u2, d, c, p, t2, u, ub);
+    relink(tb, c, a, t2);
+    relink(ub, d, c, u2);
+
+    vtris[a] = t;
+    vtris[b] = t;
+    vtris[c] = t2;
+    vtris[d] = u;
+    vtris[p] = t;
+
+    flip_stack.emplace_back(t, 2);
+    flip_stack.emplace_back(t2, 1);
+    flip_stack.emplace_back(u, 1);
+    flip_stack.emplace_back(u2, 2);
+}
+
+// remove vertex from triangulation and retriangulate the hole, keeping v id allocated
+void DelaunayMesh::unlink_vertex(int v)
+{
+    assert(!is_bound(v));
+
+    // gather star polygon, counter-clockwise,
+    // with triangles across each of its edges
+    ring.clear();
+    ring_tris.clear();
+    ring_exts.clear();
+    int t0 = vtris[v];
+    int t = t0;
+    do {
+        int k = index_in(t, v);
+        ring.push_back(tris[t].v[(k + 1) % 3]);
+        ring_tris.push_back(t);
+        ring_exts.push_back(tris[t].n[k]);
+        t = tris[t].n[(k + 1) % 3];
+        assert(t >= 0);
+    } while (t != t0);
+
+    // ear clipping, preferring ears whose circumcircle is empty
+    size_t slot = 0;
+    while (ring.size() > 3) {
+        int m = (int) ring.size();
+        int ear = -1;
+        int ear_convex = -1;
+        int ear_fallback = 0;
+        double orient_fallback = -1.0;
+        for (int i = 0; i < m && ear < 0; i++) {
+            int a = ring[(i + m - 1) % m];
+            int b = ring[i];
+            int c = ring[(i + 1) % m];
+            double o = orient(a, b, c);
+            if (o > orient_fallback) {
+                orient_fallback = o;
+                ear_fallback = i;
+            }
+            if (o <= 0) {
+                continue;
+            }
+            if (ear_convex < 0) {
+                ear_convex = i;
+            }
+
+            // use first slot as scratch triangle for circle test
+            int s = ring_tris[slot];
+            set_tri(s, a, b, c, -1, -1, -1);
+            bool empty_circle = true;
+            for (int k = 0; k < m && empty_circle; k++) {
+                int w = ring[k];
+                if (w != a && w != b && w != c && in_circle(s, w)) {
+                    empty_circle = false;
+                }
+            }
+            if (empty_circle) {
+                ear = i;
+            }
+        }
+        if (ear < 0) {
+            ear = ear_convex >= 0 ? ear_convex : ear_fallback;
+        }
+
+        int i_prev = (ear + m - 1) % m;
+        int a = ring[i_prev];
+        int b = ring[ear];
+        int c = ring[(ear + 1) % m];
+        int ext_ab = ring_exts[i_prev];
+        int ext_bc = ring_exts[ear];
+
+        int e = ring_tris[slot++];
+        // edge (c, a) is linked once the triangle on the other side is created
+        set_tri(e, a, b, c, ext_bc, -1, ext_ab);
+        relink(ext_bc, b, c, e);
+        relink(ext_ab, a, b, e);
+        vtris[a] = e;
+        vtris[b] = e;
+        vtris[c] = e;
+
+        ring_exts[i_prev] = e;
+        ring.erase(ring.begin() + ear);
+        ring_exts.erase(ring_exts.begin() + ear);
+    }
+
+    int a = ring[0];
+    int b = ring[1];
+    int c = ring[2];
+    int f = ring_tris[slot++];
+    set_tri(f, a, b, c, ring_exts[1], ring_exts[2], ring_exts[0]);
+    relink(ring_exts[1], b, c, f);
+    relink(ring_exts[2], c, a, f);
+    relink(ring_exts[0], a, b, f);
+    vtris[a] = f;
+    vtris[b] = f;
+    vtris[c] = f;
+    last_tri = f;
+
+    for (size_t k = 0; k < slot; k++) {
+        flip_stack.emplace_back(ring_tris[k], 0);
+        flip_stack.emplace_back(ring_tris[k], 1);
+        flip_stack.emplace_back(ring_tris[k], 2);
+    }
+    for (size_t k = slot; k < ring_tris.size(); k++) {
+        free_tri(ring_tris[k]);
+    }
+
+    vtris[v] = -1;
+    legalize();
+}
+
+// flip edge opposite to vertex i of t
+void DelaunayMesh::flip(int t, int i)
+{
+    // t is (p, q, r) and u is (d, r, q)
+    int p = tris[t].v[i];
+    int q = tris[t].v[(i + 1) % 3];
+    int r = tris[t].v[(i + 2) % 3];
+    int u = tris[t].n[i];
+    int tr = tris[t].n[(i + 1) % 3];
+    int tp = tris[t].n[(i + 2) % 3];
+
+    int j = tris[u].n[0] == t ? 0 : (tris[u].n[1] == t ? 1 : 2);
+    int d = tris[u].v[j];
+    int uq = tris[u].n[(j + 1) % 3];
+    int ud = tris[u].n[(j + 2) % 3];
+
+    set_tri(t, p, q, d, uq, u, tp);
+    set_tri(u, p, d, r, ud, tr, t);
+    relink(uq, q, d, t);
+    relink(tr, r, p, u);
+
+    vtris[p] = t;
+    vtris[q] = t;
+    vtris[d] = t;
+    vtris[r] = u;
+
+    flip_stack.emplace_back(t, 0);
+    flip_stack.emplace_back(t, 2);
+    flip_stack.emplace_back(u, 0);
+    flip_stack.emplace_back(u, 1);
+}
+
+// Lawson flips until all stacked edges are locally Delaunay
+void DelaunayMesh::legalize()
+{
+    size_t nb_flips = 0;
+    while (!flip_stack.empty()) {
+        int t = flip_stack.back().first;
+        int i = flip_stack.back().second;
+        flip_stack.pop_back();
+
+        // stacked edges might be stale
+        if (tris[t].v[0] < 0) {
+            continue;
+        }
+        int u = tris[t].n[i];
+        if (u < 0 || nb_flips >= MAX_FLIPS) {
+            continue;
+        }
+
+        const auto& tu = tris[u];
+        int j = tu.n[0] == t ? 0 : (tu.n[1] == t ? 1 : (tu.n[2] == t ? 2 : -1));
+        assert(j >= 0);
+        int d = tu.v[j];
+        if (!in_circle(t, d)) {
+            continue;
+        }
+
+        // only flip convex quads
+        int p = tris[t].v[i];
+        int q = tris[t].v[(i + 1) % 3];
+        int r = tris[t].v[(i + 2) % 3];
+        if (orient(p, q, d) <= 0 || orient(p, d, r) <= 0) {
+            continue;
+        }
+
+        flip(t, i);
+        nb_flips++;
+    }
+}
+
+uint32_t DelaunayMesh::rand_next()
+{
+    // xorshift32
+    rand_state ^= rand_state << 13;
+    rand_state ^= rand_state >> 17;
+    rand_state ^= rand_state << 5;
+    return rand_state;
+}
+
+};
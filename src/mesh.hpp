@@ -0,0 +1,115 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+namespace litpression {
+
+// Delaunay triangulation kept alive across frames.
+// Vertices are moved, inserted and removed incrementally,
+// the Delaunay property being restored locally with edge flips.
+// The mesh covers a fixed bounding rectangle whose 4 corners are the first vertices,
+// all other vertices must lie strictly inside it.
+class DelaunayMesh
+{
+public:
+    static const int nb_bounds = 4;
+
+    void reset(double x0, double y0, double x1, double y1);
+
+    // return id of new vertex,
+    // or -1 if point is not strictly inside bounds or coincides with another vertex
+    int insert(double x, double y);
+    void remove(int v);
+    // return false if vertex could not be moved and has been removed
+    bool move(int v, double x, double y);
+    // insert centroids of triangles larger than max_area (clamped to given rect)
+    // until no such triangle remains, ids of inserted vertices are appended to vs_new
+    void refine(double max_area, double x0, double y0, double x1, double y1, std::vector<int>& vs_new);
+
+    bool is_bound(int v) const { return v < nb_bounds; }
+    double x(int v) const { return xs[v]; }
+    double y(int v) const { return ys[v]; }
+    // vertex ids are in [0, max_vertex_id())
+    int max_vertex_id() const { return (int) xs.size(); }
+    int nb_vertices() const { return (int) (xs.size() - free_vs.size()); }
+
+    template <typename F>
+    void for_each_edge(F f) const
+    {
+        for (int t = 0; t < (int) tris.size(); t++) {
+            const auto& tri = tris[t];
+            if (tri.v[0] < 0) {
+                continue;
+            }
+            for (int i = 0; i < 3; i++) {
+                // visit shared edges once, from lowest triangle id
+                if (tri.n[i] < 0 || t < tri.n[i]) {
+                    f(tri.v[(i + 1) % 3], tri.v[(i + 2) % 3]);
+                }
+            }
+        }
+    }
+
+    template <typename F>
+    void for_each_triangle(F f) const
+    {
+        for (const auto& tri : tris) {
+            if (tri.v[0] >= 0) {
+                f(tri.v[0], tri.v[1], tri.v[2]);
+            }
+        }
+    }
+
+private:
+    struct Tri
+    {
+        // counter-clockwise vertices, v[0] is -1 for free slots
+        int v[3];
+        // n[i] is neighbor across edge opposite to v[i], -1 on bounds
+        int n[3];
+    };
+
+    std::vector<double> xs, ys;
+    // one triangle incident to each vertex, -1 for free ids
+    std::vector<int> vtris;
+    std::vector<int> free_vs;
+
+    std::vector<Tri> tris;
+    std::vector<int> free_tris;
+
+    // starting triangle for point location
+    int last_tri = 0;
+    uint32_t rand_state = 1;
+
+    // scratch buffers
+    std::vector<std::pair<int, int>> flip_stack;
+    std::vector<int> ring;
+    std::vector<int> ring_tris;
+    std::vector<int> ring_exts;
+    std::vector<int> big_tris;
+
+    double orient(int a, int b, int c) const;
+    double orient(int a, int b, double x, double y) const;
+    bool in_circle(int t, int d) const;
+    double area(int t) const;
+
+    int new_tri();
+    void free_tri(int t);
+    int new_vertex(double x, double y);
+    void free_vertex(int v);
+    void set_tri(int t, int a, int b, int c, int na, int nb, int nc);
+    void relink(int t, int a, int b, int neighbor);
+    int index_in(int t, int v) const;
+
+    int locate(double x, double y, int& nb_zeros, int& zero_i);
+    bool insert_vertex(int v);
+    void split_tri(int t, int p);
+    void split_edge(int t, int i, int p);
+    void unlink_vertex(int v);
+    void flip(int t, int i);
+    void legalize();
+    uint32_t rand_next();
+};
+
+};
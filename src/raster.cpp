@@ -0,0 +1,157 @@
+#include "raster.hpp"
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+namespace litpression {
+
+void StrokeRasterizer::reset(int width, int height)
+{
+    this->width = width;
+    this->height = height;
+    nb_tiles_x = (width + tile_size - 1) / tile_size;
+    nb_tiles_y = (height + tile_size - 1) / tile_size;
+    capsules.clear();
+}
+
+void StrokeRasterizer::add(int x0, int y0, int x1, int y1, float half_width, const uint8_t* color)
+{
+    Capsule c;
+    c.ax = (float) x0;
+    c.ay = (float) y0;
+    float dx = (float) (x1 - x0);
+    float dy = (float) (y1 - y0);
+    c.length = std::sqrt(dx * dx + dy * dy);
+    c.ux = c.length > 0.0f ? dx / c.length : 1.0f;
+    c.uy = c.length > 0.0f ? dy / c.length : 0.0f;
+    c.half_width = half_width;
+
+    c.x_min = std::max(0, (int) std::floor(std::min(x0, x1) - half_width));
+    c.y_min = std::max(0, (int) std::floor(std::min(y0, y1) - half_width));
+    c.x_max = std::min(width - 1, (int) std::ceil(std::max(x0, x1) + half_width));
+    c.y_max = std::min(height - 1, (int) std::ceil(std::max(y0, y1) + half_width));
+    if (c.x_min > c.x_max || c.y_min > c.y_max) {
+        return;
+    }
+
+    c.color[0] = color[0];
+    c.color[1] = color[1];
+    c.color[2] = color[2];
+    capsules.push_back(c);
+}
+
+void StrokeRasterizer::bin()
+{
+    // counting sort of capsules by tile, stable so painter order is kept in each tile
+    size_t nb = (size_t) nb_tiles();
+    tile_starts.assign(nb + 1, 0);
+    for (const auto& c : capsules) {
+        for (int ty = c.y_min / tile_size; ty <= c.y_max / tile_size; ty++) {
+            for (int tx = c.x_min / tile_size; tx <= c.x_max / tile_size; tx++) {
+                tile_starts[ty * nb_tiles_x + tx + 1]++;
+            }
+        }
+    }
+    for (size_t t = 0; t < nb; t++) {
+        tile_starts[t + 1] += tile_starts[t];
+    }
+
+    tile_capsules.resize(tile_starts[nb]);
+    tile_cursors.assign(tile_starts.begin(), tile_starts.end() - 1);
+    for (size_t i = 0; i < capsules.size(); i++) {
+        const auto& c = capsules[i];
+        for (int ty = c.y_min / tile_size; ty <= c.y_max / tile_size; ty++) {
+            for (int tx = c.x_min / tile_size; tx <= c.x_max / tile_size; tx++) {
+                tile_capsules[tile_cursors[ty * nb_tiles_x + tx]++] = (uint32_t) i;
+            }
+        }
+    }
+}
+
+void StrokeRasterizer::render_tiles(int t0, int t1, uint8_t* img, size_t step) const
+{
+    for (int t = t0; t < t1; t++) {
+        int tx0 = (t % nb_tiles_x) * tile_size;
+        int ty0 = (t / nb_tiles_x) * tile_size;
+        int tx1 = std::min(width, tx0 + tile_size);
+        int ty1 = std::min(height, ty0 + tile_size);
+
+        for (size_t k = tile_starts[t]; k < tile_starts[t + 1]; k++) {
+            render_capsule(capsules[tile_capsules[k]], tx0, ty0, tx1, ty1, img, step);
+        }
+    }
+}
+
+// intersect [lo, hi] with values of x such that v0 <= k * x + q <= v1
+static inline void intersect_linear(float k, float q, float v0, float v1, float& lo, float& hi)
+{
+    if (std::abs(k) < 1e-6f) {
+        if (q < v0 || q > v1) {
+            hi = lo - 1.0f;
+        }
+        return;
+    }
+    float a = (v0 - q) / k;
+    float b = (v1 - q) / k;
+    lo = std::max(lo, std::min(a, b));
+    hi = std::min(hi, std::max(a, b));
+}
+
+void StrokeRasterizer::render_capsule(const Capsule& c, int tx0, int ty0, int tx1, int ty1, uint8_t* img, size_t step) const
+{
+    const float inf = std::numeric_limits<float>::max();
+    float r = c.half_width;
+    float r_sq = r * r;
+    float bx = c.ax + c.ux * c.length;
+    float by = c.ay + c.uy * c.length;
+
+    int y_start = std::max(ty0, c.y_min);
+    int y_end = std::min(ty1 - 1, c.y_max);
+    for (int y = y_start; y <= y_end; y++) {
+        // capsule is convex, its intersection with row is the union of intersections
+        // of both caps and of body, which is a single span
+        float lo = inf;
+        float hi = -inf;
+
+        float dy = y - c.ay;
+        if (dy * dy <= r_sq) {
+            float h = std::sqrt(r_sq - dy * dy);
+            lo = std::min(lo, c.ax - h);
+            hi = std::max(hi, c.ax + h);
+        }
+        dy = y - by;
+        if (dy * dy <= r_sq) {
+            float h = std::sqrt(r_sq - dy * dy);
+            lo = std::min(lo, bx - h);
+            hi = std::max(hi, bx + h);
+        }
+
+        if (c.length > 0.0f) {
+            // body: 0 <= (p - a).u <= length and |(p - a) x u| <= r, with px = x - ax
+            float py = y - c.ay;
+            float body_lo = -inf;
+            float body_hi = inf;
+            intersect_linear(c.ux, c.uy * py, 0.0f, c.length, body_lo, body_hi);
+            intersect_linear(c.uy, -c.ux * py, -r, r, body_lo, body_hi);
+            if (body_lo <= body_hi) {
+                lo = std::min(lo, c.ax + body_lo);
+                hi = std::max(hi, c.ax + body_hi);
+            }
+        }
+
+        if (lo > hi) {
+            continue;
+        }
+        int x_start = std::max(tx0, (int) std::ceil(lo));
+        int x_end = std::min(tx1 - 1, (int) std::floor(hi));
+
+        uint8_t* row = img + y * step;
+        for (int x = x_start; x <= x_end; x++) {
+            row[3 * x] = c.color[0];
+            row[3 * x + 1] = c.color[1];
+            row[3 * x + 2] = c.color[2];
+        }
+    }
+}
+
+};
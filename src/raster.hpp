@@ -0,0 +1,56 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace litpression {
+
+// Rasterizer of strokes as capsules (segments with round caps, as thick lines drawn by cv::line).
+// Strokes are binned in the square tiles their bounding boxes touch, keeping submission order,
+// so that each tile can be rendered independently with exact painter order.
+class StrokeRasterizer
+{
+public:
+    static const int tile_size = 64;
+
+    // start new batch of strokes to draw on image of given size
+    void reset(int width, int height);
+    // ends are pixel coordinates, color is BGR
+    void add(int x0, int y0, int x1, int y1, float half_width, const uint8_t* color);
+    // bin added strokes, to be called once before rendering
+    void bin();
+
+    int nb_tiles() const { return nb_tiles_x * nb_tiles_y; }
+    // draw strokes of tiles [t0, t1) on BGR image (rows of step bytes),
+    // can be called concurrently for disjoint ranges
+    void render_tiles(int t0, int t1, uint8_t* img, size_t step) const;
+
+private:
+    struct Capsule
+    {
+        float ax, ay;
+        // unit direction and length of segment
+        float ux, uy;
+        float length;
+        float half_width;
+        // bounding box, clamped to image
+        int x_min, y_min, x_max, y_max;
+        uint8_t color[3];
+    };
+
+    int width = 0;
+    int height = 0;
+    int nb_tiles_x = 0;
+    int nb_tiles_y = 0;
+
+    std::vector<Capsule> capsules;
+    // indices of capsules of tile t are tile_capsules[tile_starts[t]:tile_starts[t + 1]]
+    std::vector<size_t> tile_starts;
+    std::vector<uint32_t> tile_capsules;
+    std::vector<size_t> tile_cursors;
+
+    void render_capsule(const Capsule& c, int tx0, int ty0, int tx1, int ty1, uint8_t* img, size_t step) const;
+};
+
+};
@@ -0,0 +1,87 @@
+#include "seq_prefetcher.hpp"
+#include <algorithm>
+#include <cstdio>
+
+namespace litpression {
+
+SeqPrefetcher::SeqPrefetcher(const std::string& path_format, int start, int stop, int stride, int nb_threads, size_t nb_ahead)
+    : path_format(path_format),
+      start(start),
+      stop(stop),
+      stride(std::max(1, stride)),
+      slots(std::max((size_t) 1, nb_ahead)),
+      decoded(slots.size(), false)
+{
+    for (int i = 0; i < std::max(1, nb_threads); i++) {
+        threads.emplace_back(&SeqPrefetcher::decode_frames, this);
+    }
+}
+
+SeqPrefetcher::~SeqPrefetcher()
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopped = true;
+    }
+    changed.notify_all();
+    for (auto& thread : threads) {
+        thread.join();
+    }
+}
+
+bool SeqPrefetcher::read(cv::Mat3b& frame)
+{
+    std::unique_lock<std::mutex> lock(mutex);
+    size_t slot = next_read % slots.size();
+    changed.wait(lock, [&] { return stopped || decoded[slot] || next_read >= end; });
+    if (!decoded[slot]) {
+        return false;
+    }
+
+    frame = slots[slot];
+    slots[slot].release();
+    decoded[slot] = false;
+    next_read++;
+    lock.unlock();
+    // slot is free for a new position
+    changed.notify_all();
+    return true;
+}
+
+void SeqPrefetcher::decode_frames()
+{
+    char path[1024];
+    while (true) {
+        size_t pos;
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            changed.wait(lock, [&] { return stopped || next_decode >= end || next_decode < next_read + slots.size(); });
+            if (stopped || next_decode >= end) {
+                return;
+            }
+            pos = next_decode++;
+        }
+
+        int frame_i = start + (int) pos * stride;
+        cv::Mat3b frame;
+        if (stop < 0 || frame_i < stop) {
+            snprintf(path, sizeof(path), path_format.c_str(), frame_i);
+            // NB: decoded outside of lock, by all threads at once
+            frame = cv::imread(path);
+        }
+
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            if (frame.empty()) {
+                end = std::min(end, pos);
+            } else if (pos < end) {
+                // (frames past end decoded by other threads are dropped)
+                slots[pos % slots.size()] = frame;
+                decoded[pos % slots.size()] = true;
+            }
+        }
+        changed.notify_all();
+    }
+}
+
+};
@@ -0,0 +1,53 @@
+#pragma once
+
+#include <condition_variable>
+#include <mutex>
+#include <opencv2/opencv.hpp>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace litpression {
+
+// frames of an image sequence decoded ahead by a pool of threads,
+// and handed out in sequence order through a reorder buffer
+class SeqPrefetcher
+{
+public:
+    // frames start, start + stride, ... before stop (-1: until first missing or undecodable frame),
+    // path_format is a printf format of frame index (ex: "frame_%04d.png").
+    // At most nb_ahead frames are decoded or waiting to be read
+    SeqPrefetcher(const std::string& path_format, int start, int stop, int stride, int nb_threads, size_t nb_ahead);
+    // stop decoding threads (pending frames are dropped)
+    ~SeqPrefetcher();
+    SeqPrefetcher(const SeqPrefetcher&) = delete;
+    SeqPrefetcher& operator=(const SeqPrefetcher&) = delete;
+
+    // next frame in order, return false at end of sequence
+    bool read(cv::Mat3b& frame);
+
+private:
+    std::string path_format;
+    int start;
+    int stop;
+    int stride;
+
+    std::mutex mutex;
+    // signaled when a frame is decoded, read, or sequence end is found
+    std::condition_variable changed;
+    // ring of frames by position in sequence, position p in slot p % size
+    // (positions in flight are within [next_read, next_read + size))
+    std::vector<cv::Mat3b> slots;
+    std::vector<bool> decoded;
+    // next position to decode and to read
+    size_t next_decode = 0;
+    size_t next_read = 0;
+    // position of first missing frame
+    size_t end = (size_t) -1;
+    bool stopped = false;
+    std::vector<std::thread> threads;
+
+    void decode_frames();
+};
+
+};
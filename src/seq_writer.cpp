@@ -0,0 +1,118 @@
+#include "seq_writer.hpp"
+#include <array>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <iostream>
+
+namespace litpression {
+
+static bool ends_with(const std::string& value, const std::string& ending)
+{
+    return value.size() >= ending.size() && value.compare(value.size() - ending.size(), ending.size(), ending) == 0;
+}
+
+bool is_seq_path(const std::string& path)
+{
+    bool has_format = path.find('%') != std::string::npos;
+    return has_format
+        && (ends_with(path, ".png") || ends_with(path, ".jpg") || ends_with(path, ".jpeg") || ends_with(path, ".exr"));
+}
+
+// sRGB 8-bit values to linear float, as expected in EXR files
+static const std::array<float, 256>& srgb_to_linear_table()
+{
+    static const std::array<float, 256> table = [] {
+        std::array<float, 256> t;
+        for (int i = 0; i < 256; i++) {
+            double c = i / 255.0;
+            t[i] = (float) (c <= 0.04045 ? c / 12.92 : std::pow((c + 0.055) / 1.055, 2.4));
+        }
+        return t;
+    }();
+    return table;
+}
+
+static void to_linear_float(const cv::Mat3b& frame, cv::Mat3f& linear)
+{
+    const auto& table = srgb_to_linear_table();
+    linear.create(frame.rows, frame.cols);
+    for (int y = 0; y < frame.rows; y++) {
+        const uchar* src = frame.ptr(y);
+        float* dst = linear.ptr<float>(y);
+        for (int x = 0; x < frame.cols * 3; x++) {
+            dst[x] = table[src[x]];
+        }
+    }
+}
+
+SeqWriter::SeqWriter(const std::string& path_format, int nb_threads, size_t capacity)
+    : path_format(path_format),
+      exr(ends_with(path_format, ".exr")),
+      pending(capacity),
+      nb_failed(0)
+{
+    if (exr) {
+        params = { cv::IMWRITE_EXR_TYPE, cv::IMWRITE_EXR_TYPE_FLOAT };
+    }
+    for (int i = 0; i < std::max(1, nb_threads); i++) {
+        threads.emplace_back(&SeqWriter::encode_frames, this);
+    }
+}
+
+SeqWriter::~SeqWriter()
+{
+    close();
+}
+
+void SeqWriter::write(const cv::Mat3b& frame)
+{
+    auto start = std::chrono::steady_clock::now();
+    pending.push({ next_index++, frame });
+    std::chrono::duration<double, std::milli> elapsed = std::chrono::steady_clock::now() - start;
+    blocked_ms += elapsed.count();
+}
+
+bool SeqWriter::close()
+{
+    // NB: remaining frames are still written by threads
+    pending.close();
+    for (auto& thread : threads) {
+        if (thread.joinable()) {
+            thread.join();
+        }
+    }
+    return nb_failed == 0;
+}
+
+void SeqWriter::print_stats(std::ostream& os) const
+{
+    pending.get_stats().print(os, "image writer queue");
+    os << "image writer: " << threads.size() << " threads, " << blocked_ms << " ms waiting for room, "
+       << nb_failed << " failed writes\n";
+}
+
+void SeqWriter::encode_frames()
+{
+    char path[1024];
+    cv::Mat3f linear;
+    PendingFrame item;
+    while (pending.pop(item)) {
+        snprintf(path, sizeof(path), path_format.c_str(), item.index);
+        bool ok;
+        if (exr) {
+            to_linear_float(item.frame, linear);
+            ok = cv::imwrite(path, linear, params);
+        } else {
+            ok = cv::imwrite(path, item.frame, params);
+        }
+        // release frame buffer as soon as possible, it may be reused by processing
+        item.frame.release();
+
+        if (!ok && nb_failed++ == 0) {
+            std::cerr << "Failed to write frame at path: " << path << std::endl;
+        }
+    }
+}
+
+};
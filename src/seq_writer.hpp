@@ -0,0 +1,55 @@
+#pragma once
+
+#include "bounded_queue.hpp"
+#include <atomic>
+#include <opencv2/opencv.hpp>
+#include <ostream>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace litpression {
+
+// return true if path is a printf format of numbered png, jpg or exr files (ex: "out_%05d.png")
+bool is_seq_path(const std::string& path);
+
+// frames written as numbered image files (format from extension), encoded by a pool of threads.
+// EXR frames are converted to linear float values
+class SeqWriter
+{
+public:
+    // first frame is numbered 1, at most capacity frames wait for a thread
+    SeqWriter(const std::string& path_format, int nb_threads, size_t capacity);
+    ~SeqWriter();
+    SeqWriter(const SeqWriter&) = delete;
+    SeqWriter& operator=(const SeqWriter&) = delete;
+
+    // queue frame without copy (it must not be modified afterwards),
+    // wait while capacity frames are pending (backpressure)
+    void write(const cv::Mat3b& frame);
+    // wait for pending frames to be written, return false if any write failed
+    bool close();
+
+    // queue depths, time spent waiting in write and failed writes
+    void print_stats(std::ostream& os) const;
+
+private:
+    struct PendingFrame
+    {
+        int index;
+        cv::Mat3b frame;
+    };
+
+    std::string path_format;
+    bool exr;
+    std::vector<int> params;
+    BoundedQueue<PendingFrame> pending;
+    std::vector<std::thread> threads;
+    int next_index = 1;
+    double blocked_ms = 0.0;
+    std::atomic<size_t> nb_failed;
+
+    void encode_frames();
+};
+
+};
@@ -0,0 +1,122 @@
+#include "stats.hpp"
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+#include <iomanip>
+
+namespace litpression {
+
+const char* stage_name(Stage stage)
+{
+    switch (stage) {
+    case Stage::front_end:
+        return "front_end";
+    case Stage::flow:
+        return "flow";
+    case Stage::move_strokes:
+        return "move_strokes";
+    case Stage::triangulate:
+        return "triangulate";
+    case Stage::del_strokes_too_close:
+        return "del_strokes_too_close";
+    case Stage::gen_new_strokes:
+        return "gen_new_strokes";
+    case Stage::orient_strokes:
+        return "orient_strokes";
+    case Stage::clip_strokes:
+        return "clip_strokes";
+    case Stage::draw_strokes:
+        return "draw_strokes";
+    case Stage::total:
+        return "total";
+    }
+    return "unknown";
+}
+
+void Stats::begin_frame()
+{
+    // stages skipped on this frame (ex: flow on first frame) count as 0
+    size_t slot = frame_count % window;
+    for (auto& stage_samples : samples) {
+        stage_samples[slot] = 0.0;
+    }
+}
+
+void Stats::record(Stage stage, double ms)
+{
+    // accumulate, a stage may be entered more than once per frame
+    samples[(size_t) stage][frame_count % window] += ms;
+}
+
+void Stats::end_frame()
+{
+    frame_count++;
+}
+
+double Stats::last(Stage stage) const
+{
+    if (frame_count == 0) {
+        return 0.0;
+    }
+    return samples[(size_t) stage][(frame_count - 1) % window];
+}
+
+double Stats::mean(Stage stage) const
+{
+    size_t n = nb_samples();
+    if (n == 0) {
+        return 0.0;
+    }
+
+    const auto& stage_samples = samples[(size_t) stage];
+    double sum = 0.0;
+    for (size_t i = 0; i < n; i++) {
+        sum += stage_samples[i];
+    }
+    return sum / n;
+}
+
+double Stats::percentile(Stage stage, double p) const
+{
+    size_t n = nb_samples();
+    if (n == 0) {
+        return 0.0;
+    }
+    assert(p >= 0.0 && p <= 100.0);
+
+    // copy on stack so that stats can be queried without allocating
+    std::array<double, window> sorted = samples[(size_t) stage];
+    // nearest-rank percentile
+    size_t rank = (size_t) std::ceil(p / 100.0 * n);
+    size_t k = rank > 0 ? rank - 1 : 0;
+    std::nth_element(sorted.begin(), sorted.begin() + k, sorted.begin() + n);
+    return sorted[k];
+}
+
+void Stats::print(std::ostream& os) const
+{
+    os << "frames: " << frame_count << " (window: " << nb_samples() << ")\n";
+    os << std::left << std::setw(24) << "stage (ms)" << std::right
+       << std::setw(10) << "last"
+       << std::setw(10) << "mean"
+       << std::setw(10) << "p50"
+       << std::setw(10) << "p95"
+       << std::setw(10) << "p99" << "\n";
+
+    auto flags = os.flags();
+    auto precision = os.precision();
+    os << std::fixed << std::setprecision(3);
+    for (size_t i = 0; i < nb_stages; i++) {
+        Stage stage = (Stage) i;
+        os << std::left << std::setw(24) << stage_name(stage) << std::right
+           << std::setw(10) << last(stage)
+           << std::setw(10) << mean(stage)
+           << std::setw(10) << percentile(stage, 50)
+           << std::setw(10) << percentile(stage, 95)
+           << std::setw(10) << percentile(stage, 99) << "\n";
+    }
+    os.flags(flags);
+    os.precision(precision);
+}
+
+};
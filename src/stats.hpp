@@ -0,0 +1,81 @@
+#pragma once
+
+#include <array>
+#include <chrono>
+#include <cstddef>
+#include <ostream>
+
+namespace litpression {
+
+// processing stages timed inside Litpression::process
+enum class Stage
+{
+    // gray, contours and gradients
+    front_end,
+    flow,
+    move_strokes,
+    triangulate,
+    del_strokes_too_close,
+    gen_new_strokes,
+    orient_strokes,
+    clip_strokes,
+    draw_strokes,
+    // whole process call
+    total,
+};
+
+const size_t nb_stages = (size_t) Stage::total + 1;
+
+const char* stage_name(Stage stage);
+
+// wall time of each stage (in ms) over a rolling window of frames
+class Stats
+{
+public:
+    // number of frames kept for rolling mean and percentiles
+    static const size_t window = 128;
+
+    void begin_frame();
+    void record(Stage stage, double ms);
+    void end_frame();
+
+    // number of frames recorded so far (not bounded by window)
+    size_t nb_frames() const { return frame_count; }
+
+    double last(Stage stage) const;
+    double mean(Stage stage) const;
+    // p in [0, 100]
+    double percentile(Stage stage, double p) const;
+
+    void print(std::ostream& os) const;
+
+private:
+    // per stage ring buffer of frame times
+    std::array<std::array<double, window>, nb_stages> samples = {};
+    size_t frame_count = 0;
+
+    size_t nb_samples() const { return frame_count < window ? frame_count : window; }
+};
+
+// record time spent in scope for a given stage
+class StageTimer
+{
+public:
+    StageTimer(Stats& stats, Stage stage)
+        : stats(stats),
+          stage(stage),
+          start(std::chrono::steady_clock::now()) {}
+
+    ~StageTimer()
+    {
+        std::chrono::duration<double, std::milli> elapsed = std::chrono::steady_clock::now() - start;
+        stats.record(stage, elapsed.count());
+    }
+
+private:
+    Stats& stats;
+    Stage stage;
+    std::chrono::steady_clock::time_point start;
+};
+
+};
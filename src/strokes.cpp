@@ -0,0 +1,75 @@
+#include "strokes.hpp"
+
+namespace litpression {
+
+template <typename T>
+static void prepend_values(std::vector<T>& values, const std::vector<T>& other_values)
+{
+    values.insert(values.begin(), other_values.begin(), other_values.end());
+}
+
+void Strokes::clear()
+{
+    xs.clear();
+    ys.clear();
+    xs_int.clear();
+    ys_int.clear();
+    thetas.clear();
+    theta_deltas.clear();
+    lengths.clear();
+    radiuses.clear();
+    color_deltas.clear();
+    vertices.clear();
+    starts.clear();
+    ends.clear();
+}
+
+void Strokes::reserve(size_t size)
+{
+    xs.reserve(size);
+    ys.reserve(size);
+    xs_int.reserve(size);
+    ys_int.reserve(size);
+    thetas.reserve(size);
+    theta_deltas.reserve(size);
+    lengths.reserve(size);
+    radiuses.reserve(size);
+    color_deltas.reserve(size);
+    vertices.reserve(size);
+    starts.reserve(size);
+    ends.reserve(size);
+}
+
+void Strokes::compact(const DelMarks& marks)
+{
+    marks.compact(xs);
+    marks.compact(ys);
+    marks.compact(xs_int);
+    marks.compact(ys_int);
+    marks.compact(thetas);
+    marks.compact(theta_deltas);
+    marks.compact(lengths);
+    marks.compact(radiuses);
+    marks.compact(color_deltas);
+    marks.compact(vertices);
+    marks.compact(starts);
+    marks.compact(ends);
+}
+
+void Strokes::prepend(const Strokes& other)
+{
+    prepend_values(xs, other.xs);
+    prepend_values(ys, other.ys);
+    prepend_values(xs_int, other.xs_int);
+    prepend_values(ys_int, other.ys_int);
+    prepend_values(thetas, other.thetas);
+    prepend_values(theta_deltas, other.theta_deltas);
+    prepend_values(lengths, other.lengths);
+    prepend_values(radiuses, other.radiuses);
+    prepend_values(color_deltas, other.color_deltas);
+    prepend_values(vertices, other.vertices);
+    prepend_values(starts, other.starts);
+    prepend_values(ends, other.ends);
+}
+
+};
@@ -0,0 +1,44 @@
+#pragma once
+
+#include "del_marks.hpp"
+#include <array>
+#include <cstdint>
+#include <opencv2/opencv.hpp>
+#include <vector>
+
+namespace litpression {
+
+// strokes stored as structure of arrays,
+// so that each pass only streams the fields it uses
+// (index order is painter order, first strokes are drawn first)
+struct Strokes
+{
+    // center
+    std::vector<float> xs, ys;
+    // rounded center
+    std::vector<int> xs_int, ys_int;
+    // orientation and its randomization
+    std::vector<float> thetas;
+    std::vector<float> theta_deltas;
+    // length before clip
+    std::vector<uint16_t> lengths;
+    std::vector<uint16_t> radiuses;
+    // per channel color randomization
+    std::vector<std::array<int8_t, 3>> color_deltas;
+    // id in persistent mesh, -1 if not using mesh backend
+    std::vector<int> vertices;
+    // ends after clip
+    std::vector<cv::Point2i> starts, ends;
+
+    size_t size() const { return xs.size(); }
+    bool empty() const { return xs.empty(); }
+
+    void clear();
+    void reserve(size_t size);
+    // remove marked strokes, keeping order of others
+    void compact(const DelMarks& marks);
+    // insert strokes of other before all strokes (ie at deepest layer)
+    void prepend(const Strokes& other);
+};
+
+};
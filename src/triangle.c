@@ -354,9 +354,19 @@
 #include <fpu_control.h>
 #endif /* LINUX */
 #ifdef TRILIBRARY
+#include <setjmp.h>
 #include "triangle.h"
 #endif /* TRILIBRARY */
 
+/* Variables that are changed by each triangulation are local to the thread  */
+/*   running it, so that meshes can be built concurrently by the library.    */
+
+#ifdef __cplusplus
+#define THREADLOCAL thread_local
+#else /* not __cplusplus */
+#define THREADLOCAL _Thread_local
+#endif /* not __cplusplus */
+
 /* A few forward declarations.                                               */
 
 #ifndef TRILIBRARY
@@ -649,8 +659,19 @@ REAL iccerrboundA, iccerrboundB, iccerrboundC;
 REAL o3derrboundA, o3derrboundB, o3derrboundC;
 
 /* Random number seed is not constant, but I've made it global anyway.       */
+/*   (It is reset at the start of each triangulation, and local to threads.) */
+
+THREADLOCAL unsigned long randomseed;         /* Current random number seed. */
+
+#ifdef TRILIBRARY
+
+/* Where triexit() returns to, instead of exiting the program, while a       */
+/*   triangulate context runs on this thread.                                */
 
-unsigned long randomseed;                     /* Current random number seed. */
+THREADLOCAL jmp_buf *triexitjump = (jmp_buf *) NULL;
+THREADLOCAL int triexitstatus;
+
+#endif /* TRILIBRARY */
 
 
 /* Mesh data structure.  Triangle operates on only one mesh, but the mesh    */
@@ -724,6 +745,7 @@ struct mesh {
 
   triangle *dummytri;
   triangle *dummytribase;    /* Keep base address so we can free() it later. */
+  int dummytribytes;         /* Size of the block, so it can be reused later. */
 
 /* Pointer to the omnipresent subsegment.  Referenced by any triangle or     */
 /*   subsegment that isn't really connected to a subsegment at that          */
@@ -731,6 +753,13 @@ struct mesh {
 
   subseg *dummysub;
   subseg *dummysubbase;      /* Keep base address so we can free() it later. */
+  int dummysubbytes;         /* Size of the block, so it can be reused later. */
+
+/* Array of vertices sorted by the divide-and-conquer algorithm.  Kept       */
+/*   between triangulations of a context, so it can be reused.              */
+
+  vertex *sortarray;
+  int sortarraysize;
 
 /* Pointer to a recently visited triangle.  Improves point location if       */
 /*   proximate vertices are inserted sequentially.                           */
@@ -1415,6 +1444,12 @@ int status;
 #endif /* not ANSI_DECLARATORS */
 
 {
+#ifdef TRILIBRARY
+  if (triexitjump != (jmp_buf *) NULL) {
+    triexitstatus = status != 0 ? status : 1;
+    longjmp(*triexitjump, 1);
+  }
+#endif /* TRILIBRARY */
   exit(status);
 }
 
@@ -3910,6 +3945,27 @@ struct memorypool *pool;
   pool->deaditemstack = (VOID *) NULL;
 }
 
+/*****************************************************************************/
+/*                                                                           */
+/*  pooldeinit()   Free to the operating system all memory taken by a pool.  */
+/*                                                                           */
+/*****************************************************************************/
+
+#ifdef ANSI_DECLARATORS
+void pooldeinit(struct memorypool *pool)
+#else /* not ANSI_DECLARATORS */
+void pooldeinit(pool)
+struct memorypool *pool;
+#endif /* not ANSI_DECLARATORS */
+
+{
+  while (pool->firstblock != (VOID **) NULL) {
+    pool->nowblock = (VOID **) *(pool->firstblock);
+    trifree((VOID *) pool->firstblock);
+    pool->firstblock = pool->nowblock;
+  }
+}
+
 /*****************************************************************************/
 /*                                                                           */
 /*  poolinit()   Initialize a pool of memory for allocation of items.        */
@@ -3942,17 +3998,35 @@ int alignment;
 #endif /* not ANSI_DECLARATORS */
 
 {
+  int alignbytes;
+  int itembytes;
+
   /* Find the proper alignment, which must be at least as large as:   */
   /*   - The parameter `alignment'.                                   */
   /*   - sizeof(VOID *), so the stack of dead items can be maintained */
   /*       without unaligned accesses.                                */
   if (alignment > sizeof(VOID *)) {
-    pool->alignbytes = alignment;
+    alignbytes = alignment;
   } else {
-    pool->alignbytes = sizeof(VOID *);
+    alignbytes = sizeof(VOID *);
+  }
+  itembytes = ((bytecount - 1) / alignbytes + 1) * alignbytes;
+
+  /* A pool kept alive by a triangulate context is already initialized.   */
+  /*   If its items have the same layout, its blocks are reused as they   */
+  /*   are (the first block keeps its size even if `firstitemcount' has   */
+  /*   grown, further blocks are chained as usual).                       */
+  if (pool->firstblock != (VOID **) NULL) {
+    if ((pool->alignbytes == alignbytes) && (pool->itembytes == itembytes) &&
+        (pool->itemsperblock == itemcount)) {
+      poolrestart(pool);
+      return;
+    }
+    pooldeinit(pool);
   }
-  pool->itembytes = ((bytecount - 1) / pool->alignbytes + 1) *
-                    pool->alignbytes;
+
+  pool->alignbytes = alignbytes;
+  pool->itembytes = itembytes;
   pool->itemsperblock = itemcount;
   if (firstitemcount == 0) {
     pool->itemsfirstblock = itemcount;
@@ -3971,27 +4045,6 @@ int alignment;
   poolrestart(pool);
 }
 
-/*****************************************************************************/
-/*                                                                           */
-/*  pooldeinit()   Free to the operating system all memory taken by a pool.  */
-/*                                                                           */
-/*****************************************************************************/
-
-#ifdef ANSI_DECLARATORS
-void pooldeinit(struct memorypool *pool)
-#else /* not ANSI_DECLARATORS */
-void pooldeinit(pool)
-struct memorypool *pool;
-#endif /* not ANSI_DECLARATORS */
-
-{
-  while (pool->firstblock != (VOID **) NULL) {
-    pool->nowblock = (VOID **) *(pool->firstblock);
-    trifree((VOID *) pool->firstblock);
-    pool->firstblock = pool->nowblock;
-  }
-}
-
 /*****************************************************************************/
 /*                                                                           */
 /*  poolalloc()   Allocate space for an item.                                */
@@ -4199,9 +4252,13 @@ int subsegbytes;
 {
   size_t alignptr;
 
-  /* Set up `dummytri', the `triangle' that occupies "outer space." */
-  m->dummytribase = (triangle *) trimalloc(trianglebytes +
-                                           m->triangles.alignbytes);
+  /* Set up `dummytri', the `triangle' that occupies "outer space."  The */
+  /*   block of a previous triangulation is reused if it is large enough. */
+  if (m->dummytribytes < trianglebytes + m->triangles.alignbytes) {
+    trifree((VOID *) m->dummytribase);
+    m->dummytribytes = trianglebytes + m->triangles.alignbytes;
+    m->dummytribase = (triangle *) trimalloc(m->dummytribytes);
+  }
   /* Align `dummytri' on a `triangles.alignbytes'-byte boundary. */
   alignptr = (size_t) m->dummytribase;
   m->dummytri = (triangle *)
@@ -4223,8 +4280,11 @@ int subsegbytes;
     /* Set up `dummysub', the omnipresent subsegment pointed to by any */
     /*   triangle side or subsegment end that isn't attached to a real */
     /*   subsegment.                                                   */
-    m->dummysubbase = (subseg *) trimalloc(subsegbytes +
-                                           m->subsegs.alignbytes);
+    if (m->dummysubbytes < subsegbytes + m->subsegs.alignbytes) {
+      trifree((VOID *) m->dummysubbase);
+      m->dummysubbytes = subsegbytes + m->subsegs.alignbytes;
+      m->dummysubbase = (subseg *) trimalloc(m->dummysubbytes);
+    }
     /* Align `dummysub' on a `subsegs.alignbytes'-byte boundary. */
     alignptr = (size_t) m->dummysubbase;
     m->dummysub = (subseg *)
@@ -4630,6 +4690,7 @@ struct behavior *b;
     pooldeinit(&m->subsegs);
     trifree((VOID *) m->dummysubbase);
   }
+  trifree((VOID *) m->sortarray);
   pooldeinit(&m->vertices);
 #ifndef CDT_ONLY
   if (b->quality) {
@@ -6623,14 +6684,39 @@ int offcenter;
 
 /*****************************************************************************/
 /*                                                                           */
-/*  triangleinit()   Initialize some variables.                              */
+/*  meshreset()   Initialize the variables of a mesh, but not its memory     */
+/*                pools, so that they can be reused.                         */
 /*                                                                           */
 /*****************************************************************************/
 
 #ifdef ANSI_DECLARATORS
-void triangleinit(struct mesh *m)
+void meshreset(struct mesh *m)
 #else /* not ANSI_DECLARATORS */
-void triangleinit(m)
+void meshreset(m)
+struct mesh *m;
+#endif /* not ANSI_DECLARATORS */
+
+{
+  m->recenttri.tri = (triangle *) NULL; /* No triangle has been visited yet. */
+  m->undeads = 0;                       /* No eliminated input vertices yet. */
+  m->samples = 1;         /* Point location should take at least one sample. */
+  m->checksegments = 0;   /* There are no segments in the triangulation yet. */
+  m->checkquality = 0;     /* The quality triangulation stage has not begun. */
+  m->incirclecount = m->counterclockcount = m->orient3dcount = 0;
+  m->hyperbolacount = m->circletopcount = m->circumcentercount = 0;
+  randomseed = 1;
+}
+
+/*****************************************************************************/
+/*                                                                           */
+/*  meshinit()   Initialize the variables of a mesh, with empty memory pools.*/
+/*                                                                           */
+/*****************************************************************************/
+
+#ifdef ANSI_DECLARATORS
+void meshinit(struct mesh *m)
+#else /* not ANSI_DECLARATORS */
+void meshinit(m)
 struct mesh *m;
 #endif /* not ANSI_DECLARATORS */
 
@@ -6643,15 +6729,31 @@ struct mesh *m;
   poolzero(&m->badtriangles);
   poolzero(&m->flipstackers);
   poolzero(&m->splaynodes);
+  m->dummytribase = (triangle *) NULL;
+  m->dummytribytes = 0;
+  m->dummysubbase = (subseg *) NULL;
+  m->dummysubbytes = 0;
+  m->sortarray = (vertex *) NULL;
+  m->sortarraysize = 0;
+
+  meshreset(m);
+}
 
-  m->recenttri.tri = (triangle *) NULL; /* No triangle has been visited yet. */
-  m->undeads = 0;                       /* No eliminated input vertices yet. */
-  m->samples = 1;         /* Point location should take at least one sample. */
-  m->checksegments = 0;   /* There are no segments in the triangulation yet. */
-  m->checkquality = 0;     /* The quality triangulation stage has not begun. */
-  m->incirclecount = m->counterclockcount = m->orient3dcount = 0;
-  m->hyperbolacount = m->circletopcount = m->circumcentercount = 0;
-  randomseed = 1;
+/*****************************************************************************/
+/*                                                                           */
+/*  triangleinit()   Initialize some variables.                              */
+/*                                                                           */
+/*****************************************************************************/
+
+#ifdef ANSI_DECLARATORS
+void triangleinit(struct mesh *m)
+#else /* not ANSI_DECLARATORS */
+void triangleinit(m)
+struct mesh *m;
+#endif /* not ANSI_DECLARATORS */
+
+{
+  meshinit(m);
 
   exactinit();                     /* Initialize exact arithmetic constants. */
 }
@@ -9986,8 +10088,14 @@ struct behavior *b;
     printf("  Sorting vertices.\n");
   }
 
-  /* Allocate an array of pointers to vertices for sorting. */
-  sortarray = (vertex *) trimalloc(m->invertices * (int) sizeof(vertex));
+  /* Allocate an array of pointers to vertices for sorting, or reuse the */
+  /*   one of a previous triangulation if it is large enough.           */
+  if (m->sortarraysize < m->invertices) {
+    trifree((VOID *) m->sortarray);
+    m->sortarraysize = m->invertices;
+    m->sortarray = (vertex *) trimalloc(m->invertices * (int) sizeof(vertex));
+  }
+  sortarray = m->sortarray;
   traversalinit(&m->vertices);
   for (i = 0; i < m->invertices; i++) {
     sortarray[i] = vertextraverse(m);
@@ -10029,7 +10137,6 @@ struct behavior *b;
 
   /* Form the Delaunay triangulation. */
   divconqrecurse(m, b, sortarray, i, 0, &hullleft, &hullright);
-  trifree((VOID *) sortarray);
 
   return removeghosts(m, b, &hullleft);
 }
@@ -16004,3 +16111,305 @@ char **argv;
   return 0;
 #endif /* not TRILIBRARY */
 }
+
+#ifdef TRILIBRARY
+
+/*****************************************************************************/
+/*                                                                           */
+/*  Triangulate contexts                                                     */
+/*                                                                           */
+/*  A context keeps the mesh and its memory pools alive from one             */
+/*  triangulation to the next, so that repeated triangulations reuse the     */
+/*  memory blocks of the previous ones (with poolrestart()) instead of        */
+/*  allocating and freeing them each time.  The "outer space" triangle and   */
+/*  subsegment and the vertex sort array are kept as well, and only grown if */
+/*  a triangulation needs larger ones.  A triangulation is done in two       */
+/*  steps:  triangulatecontextrun() builds the mesh and fills the counts of  */
+/*  `out', then triangulatecontextwrite() writes the mesh into the arrays of */
+/*  `out', which the caller may allocate from these counts.  Arrays left     */
+/*  NULL are allocated with trimalloc() as with triangulate().  Voronoi      */
+/*  diagrams are not supported.                                              */
+/*                                                                           */
+/*  Contexts are reentrant:  distinct contexts can be used by concurrent     */
+/*  threads, once triangulateinit() has been called.  Errors do not exit the */
+/*  program; the functions return the exit status instead (nonzero), and the */
+/*  mesh of the context is dropped.  (Temporary arrays allocated by the      */
+/*  failed step may leak.)                                                   */
+/*                                                                           */
+/*****************************************************************************/
+
+struct triangulatecontext {
+  struct mesh m;
+  struct behavior b;
+  struct triangulateio *in;
+  int meshed;                   /* Whether a mesh has been built and is kept. */
+};
+
+/* Initialize the exact arithmetic constants shared by all contexts.  Must  */
+/*   be called once before any context is used, and not concurrently.       */
+
+#ifdef ANSI_DECLARATORS
+void triangulateinit(void)
+#else /* not ANSI_DECLARATORS */
+void triangulateinit()
+#endif /* not ANSI_DECLARATORS */
+
+{
+  exactinit();
+}
+
+#ifdef ANSI_DECLARATORS
+struct triangulatecontext *triangulatecontextnew(void)
+#else /* not ANSI_DECLARATORS */
+struct triangulatecontext *triangulatecontextnew()
+#endif /* not ANSI_DECLARATORS */
+
+{
+  struct triangulatecontext *ctx;
+
+  ctx = (struct triangulatecontext *)
+        trimalloc((int) sizeof(struct triangulatecontext));
+  meshinit(&ctx->m);
+  ctx->in = (struct triangulateio *) NULL;
+  ctx->meshed = 0;
+  return ctx;
+}
+
+#ifdef ANSI_DECLARATORS
+void triangulatecontextfree(struct triangulatecontext *ctx)
+#else /* not ANSI_DECLARATORS */
+void triangulatecontextfree(ctx)
+struct triangulatecontext *ctx;
+#endif /* not ANSI_DECLARATORS */
+
+{
+  if (ctx == (struct triangulatecontext *) NULL) {
+    return;
+  }
+  /* The "outer space" triangle and subsegment and the sort array are  */
+  /*   kept from one triangulation to the next, like the pools.         */
+  trifree((VOID *) ctx->m.dummytribase);
+  trifree((VOID *) ctx->m.dummysubbase);
+  trifree((VOID *) ctx->m.sortarray);
+  /* Pools that were never initialized have no blocks. */
+  pooldeinit(&ctx->m.vertices);
+  pooldeinit(&ctx->m.triangles);
+  pooldeinit(&ctx->m.subsegs);
+  pooldeinit(&ctx->m.viri);
+  pooldeinit(&ctx->m.badsubsegs);
+  pooldeinit(&ctx->m.badtriangles);
+  pooldeinit(&ctx->m.flipstackers);
+  pooldeinit(&ctx->m.splaynodes);
+  trifree((VOID *) ctx);
+}
+
+/* Same steps as triangulate(), up to writing the output. */
+
+#ifdef ANSI_DECLARATORS
+void contextmesh(struct triangulatecontext *ctx, char *triswitches,
+                 struct triangulateio *in, struct triangulateio *out)
+#else /* not ANSI_DECLARATORS */
+void contextmesh(ctx, triswitches, in, out)
+struct triangulatecontext *ctx;
+char *triswitches;
+struct triangulateio *in;
+struct triangulateio *out;
+#endif /* not ANSI_DECLARATORS */
+
+{
+  struct mesh *m;
+  struct behavior *b;
+
+  m = &ctx->m;
+  b = &ctx->b;
+
+  meshreset(m);
+  parsecommandline(1, &triswitches, b);
+  m->steinerleft = b->steiner;
+  ctx->in = in;
+
+  transfernodes(m, b, in->pointlist, in->pointattributelist,
+                in->pointmarkerlist, in->numberofpoints,
+                in->numberofpointattributes);
+
+#ifdef CDT_ONLY
+  m->hullsize = delaunay(m, b);
+#else /* not CDT_ONLY */
+  if (b->refine) {
+    m->hullsize = reconstruct(m, b, in->trianglelist,
+                              in->triangleattributelist, in->trianglearealist,
+                              in->numberoftriangles, in->numberofcorners,
+                              in->numberoftriangleattributes,
+                              in->segmentlist, in->segmentmarkerlist,
+                              in->numberofsegments);
+  } else {
+    m->hullsize = delaunay(m, b);
+  }
+#endif /* not CDT_ONLY */
+
+  m->infvertex1 = (vertex) NULL;
+  m->infvertex2 = (vertex) NULL;
+  m->infvertex3 = (vertex) NULL;
+
+  if (b->usesegments) {
+    m->checksegments = 1;
+    if (!b->refine) {
+      formskeleton(m, b, in->segmentlist,
+                   in->segmentmarkerlist, in->numberofsegments);
+    }
+  }
+
+  if (b->poly && (m->triangles.items > 0)) {
+    m->holes = in->numberofholes;
+    m->regions = in->numberofregions;
+    if (!b->refine) {
+      carveholes(m, b, in->holelist, m->holes, in->regionlist, m->regions);
+    }
+  } else {
+    m->holes = 0;
+    m->regions = 0;
+  }
+
+#ifndef CDT_ONLY
+  if (b->quality && (m->triangles.items > 0)) {
+    enforcequality(m, b);
+  }
+#endif /* not CDT_ONLY */
+
+  m->edges = (3l * m->triangles.items + m->hullsize) / 2l;
+
+  if (b->order > 1) {
+    highorder(m, b);
+  }
+
+  if (b->jettison) {
+    out->numberofpoints = m->vertices.items - m->undeads;
+  } else {
+    out->numberofpoints = m->vertices.items;
+  }
+  out->numberofpointattributes = m->nextras;
+  out->numberoftriangles = m->triangles.items;
+  out->numberofcorners = (b->order + 1) * (b->order + 2) / 2;
+  out->numberoftriangleattributes = m->eextras;
+  out->numberofedges = m->edges;
+  if (b->usesegments) {
+    out->numberofsegments = m->subsegs.items;
+  } else {
+    out->numberofsegments = m->hullsize;
+  }
+  ctx->meshed = 1;
+}
+
+/* Same output as triangulate(), from the mesh of the last run. */
+
+#ifdef ANSI_DECLARATORS
+void contextwrite(struct triangulatecontext *ctx, struct triangulateio *out)
+#else /* not ANSI_DECLARATORS */
+void contextwrite(ctx, out)
+struct triangulatecontext *ctx;
+struct triangulateio *out;
+#endif /* not ANSI_DECLARATORS */
+
+{
+  struct mesh *m;
+  struct behavior *b;
+
+  m = &ctx->m;
+  b = &ctx->b;
+
+  /* Vertices are numbered even if they are not written. */
+  if (b->nonodewritten) {
+    numbernodes(m, b);
+  } else {
+    writenodes(m, b, &out->pointlist, &out->pointattributelist,
+               &out->pointmarkerlist);
+  }
+  if (!b->noelewritten) {
+    writeelements(m, b, &out->trianglelist, &out->triangleattributelist);
+  }
+  if ((b->poly || b->convex) && !b->nopolywritten && !b->noiterationnum) {
+    writepoly(m, b, &out->segmentlist, &out->segmentmarkerlist);
+    out->numberofholes = m->holes;
+    out->numberofregions = m->regions;
+    if (b->poly) {
+      out->holelist = ctx->in->holelist;
+      out->regionlist = ctx->in->regionlist;
+    } else {
+      out->holelist = (REAL *) NULL;
+      out->regionlist = (REAL *) NULL;
+    }
+  }
+  if (b->edgesout) {
+    writeedges(m, b, &out->edgelist, &out->edgemarkerlist);
+  }
+  if (b->neighbors) {
+    writeneighbors(m, b, &out->neighborlist);
+  }
+}
+
+/* Build the mesh of `in' and fill the counts of `out'.  Return 0, or the   */
+/*   exit status of the error.                                              */
+
+#ifdef ANSI_DECLARATORS
+int triangulatecontextrun(struct triangulatecontext *ctx, char *triswitches,
+                          struct triangulateio *in, struct triangulateio *out)
+#else /* not ANSI_DECLARATORS */
+int triangulatecontextrun(ctx, triswitches, in, out)
+struct triangulatecontext *ctx;
+char *triswitches;
+struct triangulateio *in;
+struct triangulateio *out;
+#endif /* not ANSI_DECLARATORS */
+
+{
+  jmp_buf errorjump;
+  jmp_buf *outerjump;
+  int status;
+
+  outerjump = triexitjump;
+  triexitjump = &errorjump;
+  if (setjmp(errorjump) == 0) {
+    contextmesh(ctx, triswitches, in, out);
+    status = 0;
+  } else {
+    status = triexitstatus;
+    ctx->meshed = 0;
+  }
+  triexitjump = outerjump;
+  return status;
+}
+
+/* Write the mesh of the last run into `out'.  Return 0, or the exit status */
+/*   of the error.                                                          */
+
+#ifdef ANSI_DECLARATORS
+int triangulatecontextwrite(struct triangulatecontext *ctx,
+                            struct triangulateio *out)
+#else /* not ANSI_DECLARATORS */
+int triangulatecontextwrite(ctx, out)
+struct triangulatecontext *ctx;
+struct triangulateio *out;
+#endif /* not ANSI_DECLARATORS */
+
+{
+  jmp_buf errorjump;
+  jmp_buf *outerjump;
+  int status;
+
+  if (!ctx->meshed) {
+    return 1;
+  }
+  outerjump = triexitjump;
+  triexitjump = &errorjump;
+  if (setjmp(errorjump) == 0) {
+    contextwrite(ctx, out);
+    status = 0;
+  } else {
+    status = triexitstatus;
+    ctx->meshed = 0;
+  }
+  triexitjump = outerjump;
+  return status;
+}
+
+#endif /* TRILIBRARY */
@@ -280,10 +280,23 @@ struct triangulateio
     int numberofedges; /* Out only */
 };
 
+/* triangulation reusing memory of previous ones, see triangle.c */
+struct triangulatecontext;
+
 #ifdef ANSI_DECLARATORS
 void triangulate(char*, struct triangulateio*, struct triangulateio*, struct triangulateio*);
 void trifree(VOID* memptr);
+void triangulateinit(void);
+struct triangulatecontext* triangulatecontextnew(void);
+void triangulatecontextfree(struct triangulatecontext*);
+int triangulatecontextrun(struct triangulatecontext*, char*, struct triangulateio*, struct triangulateio*);
+int triangulatecontextwrite(struct triangulatecontext*, struct triangulateio*);
 #else /* not ANSI_DECLARATORS */
 void triangulate();
 void trifree();
+void triangulateinit();
+struct triangulatecontext* triangulatecontextnew();
+void triangulatecontextfree();
+int triangulatecontextrun();
+int triangulatecontextwrite();
 #endif /* not ANSI_DECLARATORS */
@@ -1,7 +1,9 @@
 #include "triangle_wrapper.hpp"
+#include <algorithm>
 #include <cassert>
 #include <cstdio>
 #include <iostream>
+#include <mutex>
 #include <type_traits>
 
 #define VOID int
@@ -18,80 +20,82 @@ namespace triangle {
 
 using std::vector;
 
-vector<double> add_points(vector<double>& points_xy, double max_area)
+// caller-owned output array of n values for Triangle
+// (never null, Triangle would allocate its own otherwise)
+template <typename T>
+static T* out_array(vector<T>& values, size_t n)
 {
-    if (max_area < 0 || max_area > 100) {
-        std::cerr << "max_area must be in [0, 100] range" << std::endl;
-        exit(1);
-    }
-
-    // z: zero-indexed
-    // Q: quiet
-    // B: no boundary markers
-    // a: max triangle area
-    char tri_switches[100] = "";
-    sprintf(tri_switches, "zQBa%0.4f", max_area);
+    values.reserve(std::max((size_t) 1, n));
+    values.resize(n);
+    return values.data();
+}
 
-    struct triangulateio in = {};
-    in.numberofpoints = points_xy.size() / 2;
-    in.numberofpointattributes = 0;
-    in.pointlist = points_xy.data();
+Context::Context()
+{
+    // exact arithmetic constants are shared by all contexts
+    static std::once_flag once;
+    std::call_once(once, [] { triangulateinit(); });
+    ctx = triangulatecontextnew();
+}
 
-    struct triangulateio out = {};
-    triangulate(tri_switches, &in, &out, NULL);
+Context::~Context()
+{
+    triangulatecontextfree(ctx);
+}
 
-    static_assert(std::is_same<decltype(out.pointlist), double*>::value, "types do not match");
-    vector<double> points_xy_out;
-    points_xy_out.resize(out.numberofpoints * 2);
-    std::memcpy(points_xy_out.data(), out.pointlist, sizeof(double) * out.numberofpoints * 2);
-
-    free(out.pointlist);
-    free(out.pointattributelist);
-    free(out.pointmarkerlist);
-    free(out.trianglelist);
-    free(out.triangleattributelist);
-    free(out.neighborlist);
-    free(out.segmentlist);
-    free(out.segmentmarkerlist);
-    free(out.edgelist);
-    free(out.edgemarkerlist);
-
-    return points_xy_out;
+// on error, empty triangulation so that no stale indices are used
+static bool fail(Triangulation& tri)
+{
+    tri.edges.clear();
+    tri.triangles.clear();
+    tri.points_new.clear();
+    return false;
 }
 
-vector<int> list_edges(vector<double>& points_xy)
+bool Context::triangulate(vector<double>& points_xy, double max_area, Triangulation& tri)
 {
+    // NB: no upper bound, max area grows with load level of frame time budget
+    if (!(max_area > 0)) {
+        std::cerr << "max_area must be positive" << std::endl;
+        return fail(tri);
+    }
+
     // z: zero-indexed
     // Q: quiet
     // B: no boundary markers
     // e: provide list of edges
-    char tri_switches[] = "zQBe";
+    // a: max triangle area
+    char tri_switches[100] = "";
+    sprintf(tri_switches, "zQBea%0.4f", max_area);
 
     struct triangulateio in = {};
     in.numberofpoints = points_xy.size() / 2;
     in.numberofpointattributes = 0;
     in.pointlist = points_xy.data();
 
+    // mesh is built first, so that output arrays can be sized from its counts
     struct triangulateio out = {};
-    triangulate(tri_switches, &in, &out, NULL);
+    if (triangulatecontextrun(ctx, tri_switches, &in, &out) != 0) {
+        std::cerr << "Triangle failed to triangulate " << in.numberofpoints << " points" << std::endl;
+        return fail(tri);
+    }
+    assert(out.numberofpoints >= in.numberofpoints);
+    assert(out.numberofcorners == 3);
 
+    static_assert(std::is_same<decltype(out.pointlist), double*>::value, "types do not match");
+    out.pointlist = out_array(points_out, (size_t) out.numberofpoints * 2);
     static_assert(std::is_same<decltype(out.edgelist), int*>::value, "types do not match");
-    vector<int> edges_idxs;
-    edges_idxs.resize(out.numberofedges * 2);
-    std::memcpy(edges_idxs.data(), out.edgelist, sizeof(int) * out.numberofedges * 2);
-
-    free(out.pointlist);
-    free(out.pointattributelist);
-    free(out.pointmarkerlist);
-    free(out.trianglelist);
-    free(out.triangleattributelist);
-    free(out.neighborlist);
-    free(out.segmentlist);
-    free(out.segmentmarkerlist);
-    free(out.edgelist);
-    free(out.edgemarkerlist);
-
-    return edges_idxs;
+    out.edgelist = out_array(tri.edges, (size_t) out.numberofedges * 2);
+    static_assert(std::is_same<decltype(out.trianglelist), int*>::value, "types do not match");
+    out.trianglelist = out_array(tri.triangles, (size_t) out.numberoftriangles * 3);
+    if (triangulatecontextwrite(ctx, &out) != 0) {
+        std::cerr << "Triangle failed to write triangulation" << std::endl;
+        return fail(tri);
+    }
+
+    // Triangle keeps input points first and appends steiner points
+    tri.points_new.assign(points_out.begin() + (size_t) in.numberofpoints * 2, points_out.end());
+    return true;
 }
 
 // vector<int> list_neighbors(vector<double>& points_xy)
@@ -128,51 +132,4 @@ vector<int> list_edges(vector<double>& points_xy)
 
 //     return neighbors_idxs;
 // }
-
-// std::tuple<vector<double>, vector<int>> triangulate(vector<double>& points_xy, double max_area)
-// {
-//     if (max_area < 0 || max_area > 100) {
-//         std::cerr << "max_area must be in [0, 100] range" << std::endl;
-//         exit(1);
-//     }
-
-//     // z: zero-indexed
-//     // Q: quiet
-//     // B: no boundary markers
-//     // a: max triangle area
-//     // n: provide list of neighbpprs
-//     char tri_switches[100] = "";
-//     sprintf(tri_switches, "zQBa%0.4f", max_area);
-
-//     struct triangulateio in = {};
-//     in.numberofpoints = points_xy.size() / 2;
-//     in.numberofpointattributes = 0;
-//     in.pointlist = points_xy.data();
-
-//     struct triangulateio out = {};
-//     triangulate(tri_switches, &in, &out, NULL);
-
-//     static_assert(std::is_same<decltype(out.pointlist), double*>::value, "types do not match");
-//     vector<double> points_xy_out;
-//     points_xy_out.resize(out.numberofpoints * 2);
-//     std::memcpy(points_xy_out.data(), out.pointlist, sizeof(double) * out.numberofpoints * 2);
-
-//     static_assert(std::is_same<decltype(out.neighborlist), int*>::value, "types do not match");
-//     vector<int> neighbors_idxs;
-//     neighbors_idxs.resize(out.numberoftriangles * 2);
-//     std::memcpy(neighbors_idxs.data(), out.neighborlist, sizeof(int) * out.numberoftriangles * 3);
-
-//     free(out.pointlist);
-//     free(out.pointattributelist);
-//     free(out.pointmarkerlist);
-//     free(out.trianglelist);
-//     free(out.triangleattributelist);
-//     free(out.neighborlist);
-//     free(out.segmentlist);
-//     free(out.segmentmarkerlist);
-//     free(out.edgelist);
-//     free(out.edgemarkerlist);
-
-//     return {points_xy_out, neighbors_idxs};
-// }
 }
@@ -1,13 +1,42 @@
 #pragma once
 
-#include <tuple>
 #include <vector>
 
+// Triangle's opaque context
+struct triangulatecontext;
+
 namespace triangle {
 
-std::vector<double> add_points(std::vector<double>& points_xy, double max_area = 0.0);
-std::vector<int> list_edges(std::vector<double>& points_xy);
-// std::vector<int> list_neighbors(std::vector<double>& points_xy);
+struct Triangulation
+{
+    // pairs of point indices
+    std::vector<int> edges;
+    // triplets of point indices
+    std::vector<int> triangles;
+    // coordinates of points added by refinement,
+    // indexed after input points in edges and triangles
+    std::vector<double> points_new;
+};
+
+// Triangle state kept across triangulations, so that its memory pools are reused.
+// Distinct contexts can be used by concurrent threads
+class Context
+{
+public:
+    Context();
+    ~Context();
+    Context(const Context&) = delete;
+    Context& operator=(const Context&) = delete;
 
-// std::tuple<std::vector<double>, std::vector<int>> triangulate(std::vector<double>& points_xys, double max_area);
+    // Delaunay triangulation refined so that no triangle is larger than max_area,
+    // written to tri whose vectors are reused (no reallocation once their capacity is reached).
+    // Return false on error (reported to stderr), with tri left empty
+    bool triangulate(std::vector<double>& points_xy, double max_area, Triangulation& tri);
+
+private:
+    struct triangulatecontext* ctx;
+    // all output points, input points first
+    std::vector<double> points_out;
+};
+// std::vector<int> list_neighbors(std::vector<double>& points_xy);
 }